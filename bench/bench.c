@@ -0,0 +1,91 @@
+// Runs the benchmarks of the library in a Lua state with a counting allocator.
+//
+// usage: bench/bench script [args...]
+//
+// The script gets its arguments in `arg` and the `bench` table, with:
+//
+// * `bench.now()`: a monotonic clock, in seconds;
+// * `bench.allocations()`: the number of allocations performed by the state so far.
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <lauxlib.h>
+#include <lualib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+extern int luaopen_ldk_checks(lua_State *L);
+
+static size_t allocations = 0;
+
+static void *counting_alloc(void *ud, void *ptr, size_t osize, size_t nsize)
+{
+    (void)ud;
+    if (nsize == 0)
+    {
+        free(ptr);
+        return NULL;
+    }
+    // a block grows or is created; shrinking is not an allocation
+    if (ptr == NULL || nsize > osize) allocations++;
+    return realloc(ptr, nsize);
+}
+
+static int bench_now(lua_State *L)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    lua_pushnumber(L, (lua_Number)ts.tv_sec + (lua_Number)ts.tv_nsec * 1e-9);
+    return 1;
+}
+
+static int bench_allocations(lua_State *L)
+{
+    lua_pushinteger(L, (lua_Integer)allocations);
+    return 1;
+}
+
+static const struct luaL_Reg bench_funcs[] = {
+    {"now", bench_now},
+    {"allocations", bench_allocations},
+    {NULL, NULL},
+};
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s script [args...]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    lua_State *L = lua_newstate(counting_alloc, NULL);
+    if (L == NULL)
+    {
+        fprintf(stderr, "cannot create the Lua state\n");
+        return EXIT_FAILURE;
+    }
+    luaL_openlibs(L);
+    luaL_requiref(L, "ldk.checks", luaopen_ldk_checks, 0); // checks
+    lua_pop(L, 1);
+
+    luaL_newlib(L, bench_funcs); // bench
+    lua_setglobal(L, "bench");
+
+    lua_createtable(L, argc - 2, 1); // arg
+    for (int i = 1; i < argc; i++)
+    {
+        lua_pushstring(L, argv[i]); // arg argv[i]
+        lua_rawseti(L, -2, i - 1);  // arg
+    }
+    lua_setglobal(L, "arg");
+
+    int status = luaL_dofile(L, argv[1]);
+    if (status != LUA_OK)
+    {
+        fprintf(stderr, "%s\n", lua_tostring(L, -1));
+    }
+    lua_close(L);
+    return status == LUA_OK ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,88 @@
+-- Measures, under LuaJIT, the cost of checking primitive descriptors in a hot loop with the
+-- functions of the library and with the ones of `ldk.checks.fast`, and counts the traces that the
+-- compiler aborts in each loop.
+--
+-- usage: luajit bench/jit.lua [iterations]
+--
+-- The run fails if a loop of `ldk.checks.fast` aborts a trace.
+
+local checks = require 'ldk.checks'
+local fast = require 'ldk.checks.fast'
+
+if not jit then
+  error('this benchmark requires LuaJIT', 0)
+end
+
+local iterations = tonumber(arg and arg[1]) or 10000000
+
+local aborts = 0
+local function on_trace(what)
+  if what == 'abort' then aborts = aborts + 1 end
+end
+jit.attach(on_trace, 'trace')
+
+local function measure(f)
+  f(1000)
+  jit.flush()
+  aborts = 0
+  local t0 = os.clock()
+  f(iterations)
+  local elapsed = os.clock() - t0
+  return elapsed * 1e9 / iterations, aborts
+end
+
+local values = {1, 'x', {}, 2.5}
+
+-- name, library loop, fast loop
+local cases = {
+  {'is integer', function(n)
+    local is, count = checks.is, 0
+    for i = 1, n do if is(values[i % 4 + 1], 'integer') then count = count + 1 end end
+    return count
+  end, function(n)
+    local is, count = fast.is, 0
+    for i = 1, n do if is(values[i % 4 + 1], 'integer') then count = count + 1 end end
+    return count
+  end},
+  {'is ?string|table', function(n)
+    local is, count = checks.is, 0
+    for i = 1, n do if is(values[i % 4 + 1], '?string|table') then count = count + 1 end end
+    return count
+  end, function(n)
+    local is, count = fast.is, 0
+    for i = 1, n do if is(values[i % 4 + 1], '?string|table') then count = count + 1 end end
+    return count
+  end},
+  {'which', function(n)
+    local which, count = checks.which, 0
+    for i = 1, n do count = count + (which(values[i % 4 + 1], 'string', 'number') or 0) end
+    return count
+  end, function(n)
+    local which, count = fast.which, 0
+    for i = 1, n do count = count + (which(values[i % 4 + 1], 'string', 'number') or 0) end
+    return count
+  end},
+  {'check_type / check', function(n)
+    local check_type = checks.check_type
+    local function f(x) check_type(1, 'number|string|table') return x end
+    for i = 1, n do f(values[i % 4 + 1]) end
+  end, function(n)
+    local check = fast.check
+    local function f(x) check(x, 'number|string|table', 1) return x end
+    for i = 1, n do f(values[i % 4 + 1]) end
+  end},
+}
+
+local failures = {}
+print(('%-22s %12s %8s %12s %8s'):format('benchmark', 'ns/call', 'aborts', 'fast ns/call', 'aborts'))
+for _, case in ipairs(cases) do
+  local ns, case_aborts = measure(case[2])
+  local fast_ns, fast_aborts = measure(case[3])
+  print(('%-22s %12.1f %8d %12.1f %8d'):format(case[1], ns, case_aborts, fast_ns, fast_aborts))
+  if fast_aborts > 0 then failures[#failures + 1] = case[1] end
+end
+jit.attach(on_trace)
+
+if #failures > 0 then
+  error(('traces aborted in: %s'):format(table.concat(failures, ', ')), 0)
+end
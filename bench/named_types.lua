@@ -0,0 +1,31 @@
+-- Measures the cost of checking named types (`__type`/`__name`) against the cost of checking a
+-- primitive type and of the equivalent pure-Lua test.
+--
+-- usage: lua bench/named_types.lua [iterations]
+--
+-- `make bench-names` runs it with and without the cache of the type names of the metatables.
+
+local checks = require 'ldk.checks'
+local check_type = checks.check_type
+
+local iterations = tonumber(arg and arg[1]) or 1000000
+
+local function measure(name, f, x)
+  f(x)
+  local t0 = os.clock()
+  for _ = 1, iterations do f(x) end
+  local elapsed = os.clock() - t0
+  print(('%-28s %8.1f ns/call'):format(name, elapsed * 1e9 / iterations))
+end
+
+local Point = {__type = 'Point'}
+local point = setmetatable({}, Point)
+
+measure('table', function(_) check_type(1, 'table') end, point)
+measure('Point (table __type)', function(_) check_type(1, 'Point') end, point)
+measure('Line|Point (table __type)', function(_) check_type(1, 'Line|Point') end, point)
+measure('FILE* (userdata __name)', function(_) check_type(1, 'FILE*') end, io.stdout)
+measure('Point (pure Lua)', function(x)
+  local mt = getmetatable(x)
+  if not (mt and mt.__type == 'Point') then error('Point expected') end
+end, point)
@@ -0,0 +1,113 @@
+-- Measures the cost per call of the checks, and compares it with a pure-Lua baseline and with the
+-- results stored by a previous run.
+--
+-- usage: bench/bench bench/run.lua [iterations=N] [threshold=T] [results=FILE] [save]
+--
+-- With `save` the results are written to FILE (bench/results.lua by default); otherwise the run
+-- fails if a benchmark is slower than its stored result by more than the fraction T (0.25 by
+-- default).
+
+local checks = require 'ldk.checks'
+local now, allocations = bench.now, bench.allocations
+
+local options = {iterations = 1000000, threshold = 0.25, results = 'bench/results.lua'}
+for _, a in ipairs(arg) do
+  local k, v = a:match('^(%w+)=(.*)$')
+  if k then
+    options[k] = tonumber(v) or v
+  else
+    options[a] = true
+  end
+end
+local iterations = options.iterations
+
+local check_type, check_types, check_option = checks.check_type, checks.check_types, checks.check_option
+
+local function measure(f, ...)
+  f(...)
+  collectgarbage('collect')
+  local a0 = allocations()
+  local t0 = now()
+  for _ = 1, iterations do f(...) end
+  local elapsed = now() - t0
+  return elapsed * 1e9 / iterations, (allocations() - a0) / iterations
+end
+
+local function fails(f)
+  return function(...) pcall(f, ...) end
+end
+
+local Point = {__type = 'Point'}
+local point = setmetatable({}, Point)
+checks.register('even', function(x) return math.type(x) == 'integer' and x % 2 == 0 end)
+
+-- name, checked function, baseline function (or false), arguments
+local cases = {
+  {'check_type integer', function(_) check_type(1, 'integer') end,
+   function(x) if math.type(x) ~= 'integer' then error('integer expected') end end, 1},
+  {'check_type ?string|table', function(_) check_type(1, '?string|table') end,
+   function(x) local t = type(x) if t ~= 'nil' and t ~= 'string' and t ~= 'table' then error('bad') end end, {}},
+  {'check_type Point', function(_) check_type(1, 'Point') end,
+   function(x) local mt = getmetatable(x) if not (mt and mt.__type == 'Point') then error('bad') end end, point},
+  {'check_type FILE*', function(_) check_type(1, 'FILE*') end, false, io.stdout},
+  {'check_type registered', function(_) check_type(1, 'even') end, false, 2},
+  {'check_type {integer}', function(_) check_type(1, '{integer}') end, false, {1, 2, 3, 4}},
+  {'check_types fixed', function(_, _, _) check_types('string', 'integer', '?table') end,
+   function(a, b, c)
+     if type(a) ~= 'string' or math.type(b) ~= 'integer' or (c ~= nil and type(c) ~= 'table') then error('bad') end
+   end, 'x', 1, nil},
+  {'check_types *', function(...) check_types('*integer') end, false, 1, 2, 3},
+  {'check_types +', function(...) check_types('+integer') end, false, 1, 2, 3},
+  {'check_option', function(_) check_option(1, 'one|two|three') end,
+   function(x) if x ~= 'one' and x ~= 'two' and x ~= 'three' then error('bad') end end, 'three'},
+  {'fail check_type', fails(function(_) check_type(1, 'integer') end),
+   fails(function(x) if math.type(x) ~= 'integer' then error('integer expected') end end), 'x'},
+  {'fail check_type missing', fails(function(_, _) check_type(2, 'integer') end), false, 1},
+  {'fail check_type named', fails(function(_) check_type(1, 'Point') end), false, {}},
+  {'fail check_types', fails(function(_, _) check_types('string', 'integer') end), false, 'x', 'y'},
+  {'fail check_option', fails(function(_) check_option(1, 'one|two|three') end), false, 'four'},
+}
+
+local function load_results(path)
+  local chunk = loadfile(path, 't', {})
+  return chunk and chunk() or nil
+end
+
+local stored = not options.save and load_results(options.results)
+local results, regressions = {}, {}
+
+print(('%-28s %10s %10s %10s %10s'):format('benchmark', 'ns/call', 'allocs', 'baseline', 'stored'))
+for _, case in ipairs(cases) do
+  local name, f, baseline = case[1], case[2], case[3]
+  local ns, allocs = measure(f, table.unpack(case, 4))
+  local baseline_ns = baseline and measure(baseline, table.unpack(case, 4))
+  local stored_ns = stored and stored[name]
+  results[name] = ns
+  print(('%-28s %10.1f %10.2f %10s %10s'):format(name, ns, allocs,
+    baseline_ns and ('%.1f'):format(baseline_ns) or '-',
+    stored_ns and ('%.1f'):format(stored_ns) or '-'))
+  if stored_ns and ns > stored_ns * (1 + options.threshold) then
+    regressions[#regressions + 1] = ('%s: %.1f ns/call, stored %.1f'):format(name, ns, stored_ns)
+  end
+end
+
+if options.save then
+  local names = {}
+  for name in pairs(results) do names[#names + 1] = name end
+  table.sort(names)
+  local file = assert(io.open(options.results, 'w'))
+  file:write('return {\n')
+  for _, name in ipairs(names) do
+    file:write(('  [%q] = %.1f,\n'):format(name, results[name]))
+  end
+  file:write('}\n')
+  file:close()
+  print(('results saved to %s'):format(options.results))
+elseif not stored then
+  print(('no stored results in %s; run with `save` to store them'):format(options.results))
+end
+
+if #regressions > 0 then
+  error(('%d regression(s) past %g%%:\n  %s'):format(#regressions, options.threshold * 100,
+    table.concat(regressions, '\n  ')), 0)
+end
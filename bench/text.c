@@ -0,0 +1,110 @@
+// Measures the throughput of the string content kernels of libtext, for each supported instruction
+// set, on ASCII and on mixed UTF-8 strings of 16 bytes to 16 MB.
+//
+// usage: bench/text [megabytes]
+//
+// Each measurement scans about `megabytes` MB (256 by default).
+
+#define _POSIX_C_SOURCE 199309L
+
+#include "libtext.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define MIN_SIZE 16
+#define MAX_SIZE (16 << 20)
+
+static const char *const isa_names[] = {"scalar", "sse2", "avx2"};
+
+typedef bool (*kernel)(const char *s, size_t len);
+
+static const struct
+{
+    const char *name;
+    kernel f;
+} kernels[] = {
+    {"ascii", textL_isascii},
+    {"utf8", textL_isutf8},
+    {"printable", textL_isprintable},
+};
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// fills a buffer with text: ASCII, or a mix of one to four byte sequences.
+static void fill(char *s, size_t size, bool ascii)
+{
+    static const char *const samples[] = {"text ", "caf\xc3\xa9 ", "\xe2\x82\xac", "\xf0\x9f\x98\x80"};
+    size_t i = 0;
+    for (unsigned k = 0; i < size; k++)
+    {
+        const char *sample = samples[ascii ? 0 : k % 4];
+        size_t n = strlen(sample);
+        if (i + n > size)
+        {
+            memset(s + i, ' ', size - i);
+            break;
+        }
+        memcpy(s + i, sample, n);
+        i += n;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    double megabytes = argc > 1 ? atof(argv[1]) : 256;
+    if (megabytes <= 0)
+    {
+        fprintf(stderr, "usage: %s [megabytes]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    char *s = malloc(MAX_SIZE);
+    if (s == NULL) return EXIT_FAILURE;
+
+    textL_isa best = textL_setisa(TEXTL_AVX2);
+    printf("%-10s %-6s %-6s %10s %10s\n", "kernel", "input", "isa", "size", "GB/s");
+    for (size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++)
+    {
+        for (int input = 0; input < 2; input++)
+        {
+            if (k == 0 && input == 1) continue;
+            for (size_t size = MIN_SIZE; size <= MAX_SIZE; size *= 16)
+            {
+                fill(s, size, input == 0);
+                size_t iterations = (size_t)(megabytes * (1 << 20) / (double)size);
+                if (iterations == 0) iterations = 1;
+                for (int isa = TEXTL_SCALAR; isa <= (int)best; isa++)
+                {
+                    textL_setisa((textL_isa)isa);
+                    kernel volatile f = kernels[k].f; // not inlined nor hoisted out of the loop
+                    size_t matches = 0;
+                    double t0 = now();
+                    for (size_t i = 0; i < iterations; i++)
+                    {
+                        matches += f(s, size);
+                    }
+                    double elapsed = now() - t0;
+                    if (matches != iterations)
+                    {
+                        fprintf(stderr, "%s rejected its input\n", kernels[k].name);
+                        return EXIT_FAILURE;
+                    }
+                    printf("%-10s %-6s %-6s %10zu %10.2f\n", kernels[k].name, input == 0 ? "ascii" : "utf8",
+                           isa_names[isa], size, (double)size * (double)iterations / elapsed / 1e9);
+                }
+            }
+        }
+    }
+
+    free(s);
+    return EXIT_SUCCESS;
+}
@@ -3,672 +3,4186 @@
  * @module ldk.checks
  */
 
+#include "compat.h"
+#include "ldk_checks.h"
 #include "liberror.h"
+#include "libtext.h"
 
 #include <assert.h>
 #include <ctype.h>
+#include <errno.h>
 #include <lauxlib.h>
+#include <limits.h>
+#include <math.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
+#include <time.h>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define STATS_CLOCK_UNIT "cycles"
+#define stats_clock() ((uint64_t)__rdtsc())
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define STATS_CLOCK_UNIT "cycles"
+#define stats_clock() ((uint64_t)__rdtsc())
+#else
+#define STATS_CLOCK_UNIT "clock ticks"
+#define stats_clock() ((uint64_t)clock())
+#endif
 
 #define str_len(x) (sizeof(x) - 1)
 #define str_leq(x, xl, y, yl) ((yl) == (xl) && strncmp(x, y, xl) == 0)
 #define str_eq(x, xl, y) ((xl) == str_len(y) && strncmp(x, y, xl) == 0)
 
-static int checkers_ref = LUA_NOREF;
+// registry key of the per-state table of registered checkers
+static const char checkers_key = 'k';
+
+// registry key of the per-state table of native checkers
+static const char natives_key = 'n';
+
+// registry key of the per-state cache of compiled descriptors
+static const char descriptors_key = 'd';
+
+// registry key of the per-state table of the compiled descriptors keyed on their address (weak)
+static const char descriptor_refs_key = 'r';
+
+// registry key of the per-state cache of the compiled descriptors used by C modules, keyed on their address
+static const char c_descriptors_key = 'D';
+
+// registry key of the per-state cache of the compiled option descriptors of check_option, keyed on
+// the options
+static const char options_key = 'o';
+
+// registry keys of the per-state caches of the type names of tables and userdata, keyed on metatables
+static const char table_names_key = 't';
+static const char userdata_names_key = 'u';
+
+// registry key of the per-state table of the counters of the call sites of the checks
+static const char sites_key = 's';
 
-static const char *get_meta_field(lua_State *L, int arg, const char *field_name, size_t *len)
+// registry keys of the per-state tables of the schemas registered as named types, keyed on their
+// names, and of the same schemas keyed on their address (weak)
+static const char schemas_key = 'S';
+static const char schema_refs_key = 'R';
+
+// registry key of the arena of the running validation pass
+static const char pass_key = 'p';
+
+// registry key of the per-state table of the classes, keyed on their metatables
+static const char classes_key = 'C';
+
+// registry key of the per-state cache of the results of the pure checkers, keyed on the checked
+// tables and userdata (weak)
+static const char memo_key = 'm';
+
+#define TYPE_BIT(t) (1u << (t))
+#define DESC_INTEGER (1u << LUA_NUMTAGS)
+#define DESC_FLOAT (1u << (LUA_NUMTAGS + 1))
+#define DESC_FILE (1u << (LUA_NUMTAGS + 2))
+#define DESC_ARRAY (1u << (LUA_NUMTAGS + 3))
+#define DESC_USERDATA (TYPE_BIT(LUA_TUSERDATA) | TYPE_BIT(LUA_TLIGHTUSERDATA))
+#define DESC_ANY ((TYPE_BIT(LUA_NUMTAGS) - 1) & ~TYPE_BIT(LUA_TNIL))
+
+typedef struct
 {
-    int field_type = luaL_getmetafield(L, arg, field_name);
-    if (field_type == LUA_TNIL) return NULL;
+    const char *name;
+    size_t len;
+    unsigned hash; // see str_hash
+} type_name;
 
-    const char *value;
-    if (field_type == LUA_TSTRING)
-    {
-        value = lua_tolstring(L, -1, len);
-    }
-    lua_pop(L, 1);
-    return value;
-}
+// A native checker registered with ldk_checks_api.register_predicate.
+typedef struct
+{
+    unsigned hash;
+    size_t len;
+    const char *name; // anchored in the uservalue of the table
+    ldk_checks_predicate predicate;
+    void *ud;
+} native_checker;
 
-// must be called with the value to check at the top of the stack
-static const char *get_specific_type(lua_State *L, int type, size_t *len)
+// The native checkers of a state: an open addressing hash table, with linear probing, keyed on the
+// checker names.
+typedef struct
 {
-    if (type == LUA_TNUMBER)
-    {
-        if (lua_isinteger(L, -1))
-        {
-            *len = str_len("integer");
-            return "integer";
-        }
-        *len = str_len("float");
-        return "float";
-    }
+    size_t capacity; // a power of two
+    size_t count;
+    native_checker slots[];
+} native_checkers;
 
-    const char *name = NULL;
-    if (type == LUA_TUSERDATA)
-    {
-        name = get_meta_field(L, -1, "__name", len);
-    }
-    else if (type == LUA_TTABLE)
-    {
-        name = get_meta_field(L, -1, "__type", len);
-    }
-    if (name == NULL)
-    {
-        name = lua_typename(L, type);
-        *len = strlen(name);
-    }
-    return name;
-}
+#define NATIVES_CAPACITY 16
 
-static inline void append_descriptor0(luaL_Buffer *b, const char *p, size_t len, bool is_option)
+// the types that accept a `[min,max]` suffix: bounds on the value of numbers, or on the length of
+// strings and tables
+#define DESC_BOUNDABLE (TYPE_BIT(LUA_TNUMBER) | DESC_INTEGER | DESC_FLOAT | TYPE_BIT(LUA_TSTRING) | TYPE_BIT(LUA_TTABLE))
+#define BOUNDS_MAX 5
+
+// The bounds of an alternative with a `[min,max]` suffix; either bound can be omitted.
+typedef struct
 {
-    if (is_option)
-    {
-        luaL_addchar(b, '\'');
-        luaL_addlstring(b, p, len);
-        luaL_addchar(b, '\'');
-    }
-    else if (str_eq(p, len, "any"))
-    {
-        luaL_addstring(b, "anything but nil");
-    }
-    else
-    {
-        luaL_addlstring(b, p, len);
-    }
+    unsigned bit; // the type of the alternative, one of the DESC_BOUNDABLE bits
+    bool has_min;
+    bool has_max;
+    lua_Integer min, max;  // for integers, and for the lengths of strings and tables
+    lua_Number fmin, fmax; // for floats and numbers
+} type_bound;
+
+// A descriptor parsed once and cached, keyed on the descriptor string.
+typedef struct
+{
+    unsigned mask;          // accepted primitive types, plus the DESC_* flags
+    char repeat;            // `*`, `+` or 0
+    bool is_option;         // the descriptor is prefixed with `:`
+    int name_count;         // number of named types, or of options
+    const type_name *names; // named types, matched against `__name`/`__type` or registered checkers, or options
+    const int *option_slots; // open addressing hash table of indices into `names`, or NULL; -1 if empty
+    unsigned option_mask;   // number of slots of `option_slots` minus one
+    int bound_count;        // number of bounded alternatives, whose types are not in `mask`
+    const type_bound *bounds; // the bounds of the bounded alternatives
+    const char *text;       // the descriptor as written
+    size_t text_len;        //
+    const char *body;       // the descriptor without the repeat prefix
+    size_t body_len;        //
+    const void *element;    // the descriptor of the elements of the `{...}` alternative, if any
+    lua_Integer limit;      // number of elements of the `{...}` alternative to check, or 0 for all
+    lua_Integer slow_hits;  // number of matches that went past the primitive types
+    lua_Integer checker_calls; // number of calls to registered Lua checkers
+    bool forced;            // the checks against the descriptor are never sampled out
+} descriptor;
+
+// registry key of the per-state context
+static const char context_key = 'c';
+
+enum
+{
+    CHECKS_OFF,
+    CHECKS_PRIMITIVE,
+    CHECKS_FULL,
+};
+
+static const char *const check_levels[] = {"off", "primitive", "full", NULL};
+
+enum
+{
+    ERRORS_STRING,
+    ERRORS_OBJECT,
+};
+
+static const char *const error_modes[] = {"string", "object", NULL};
+
+// slots of the context uservalue
+enum
+{
+    CONTEXT_LIB = 1,   // the library table
+    CONTEXT_MODULES,   // module name -> check level
+    CONTEXT_FUNCTIONS, // function -> check level, resolved from CONTEXT_MODULES (weak keys)
+    CONTEXT_SAMPLING,  // module name or function -> sampling rate
+    CONTEXT_SAMPLED,   // function -> sampling rate, resolved from CONTEXT_SAMPLING (weak keys)
+};
+
+enum
+{
+    STATS_OFF,
+    STATS_ON,
+    STATS_TIMING,
+};
+
+static const char *const stats_modes[] = {"off", "on", "timing", NULL};
+
+// the instrumented check functions
+enum
+{
+    STATS_CHECK_ARG,
+    STATS_CHECK_OPTION,
+    STATS_CHECK_TYPE,
+    STATS_CHECK_TYPES,
+    STATS_SIGNATURE,
+    STATS_WRAP,
+    STATS_C_CHECKTYPE,
+    STATS_C_CHECKTYPES,
+    STATS_FUNCTION_COUNT,
+};
+
+static const char *const stats_functions[] = {
+    "check_arg", "check_option", "check_type", "check_types", "signature", "wrap", "ldk_checktype", "ldk_checktypes",
+};
+
+// The counters of a check function or of a call site.
+typedef struct
+{
+    lua_Integer calls;
+    lua_Integer failures;
+    uint64_t time;             // in units of STATS_CLOCK_UNIT, when timing
+    lua_Integer slow_hits;     // matches that went past the primitive types, per call site
+    lua_Integer checker_calls; // calls to registered checks, per call site
+} check_stats;
+
+#define SAMPLE_BITS 8
+#define SAMPLE_SLOTS (1 << SAMPLE_BITS)
+
+#define SCHEMA_MAX_DEPTH 100
+#define SCHEMA_MAX_DEPTH_LIMIT 1000
+
+typedef struct schema_pass schema_pass;
+
+// Per-state settings; the library functions get the context as their first upvalue.
+typedef struct
+{
+    int check_level;     // the check level of the modules without their own
+    int module_count;    // number of modules with their own check level
+    int error_mode;      // how failed checks are reported
+    int stats_mode;      // whether, and how, the checks are counted
+    bool stats_entered;  // set by stats_call right before calling the instrumented function
+    check_stats *site;   // the counters of the call site of the running check, or NULL
+    check_stats *active; // the counters of the running check function, or NULL
+    uint64_t start;      // the clock at the start of the running check
+    check_stats functions[STATS_FUNCTION_COUNT];
+    int sampling;        // the sampling rate of the modules without their own
+    int sampling_count;  // number of modules and functions with their own sampling rate
+    int forced_count;    // number of descriptors never sampled out
+    uint32_t samples[SAMPLE_SLOTS]; // call counters, indexed by a hash of the call site
+    int max_depth;       // the maximum nesting of the schemas checked in a validation pass
+    schema_pass *pass;   // the running validation pass, or NULL
+    lua_Integer generation; // the generation of the cached results of the pure checkers
+    lua_Integer pure_count; // number of pure checkers registered so far
+    int c_descriptor_count; // number of cached descriptors of the C interface
+    int option_count;       // number of cached option descriptors
+    int descriptor_count;   // number of cached descriptors
+} context;
+
+#define SAMPLING_ENABLED(ctx) ((ctx)->sampling > 1 || (ctx)->sampling_count > 0)
+
+#define CONTEXT_INDEX lua_upvalueindex(1)
+
+static context *get_state_context(lua_State *L)
+{
+    lua_rawgetp(L, LUA_REGISTRYINDEX, &context_key); // ctx
+    context *ctx = (context *)lua_touserdata(L, -1);
+    lua_pop(L, 1);
+    return ctx;
 }
 
-static void append_descriptor(luaL_Buffer *b, const char *descriptor, size_t descriptor_len, bool is_option)
+// The counters of the check running when another check starts.
+typedef struct
 {
-    const char *p = descriptor;
-    const char *e = descriptor + descriptor_len;
+    check_stats *site;
+    check_stats *active;
+    uint64_t start;
+} stats_frame;
 
-    if (!is_option)
+// starts counting a check performed by `function` on behalf of the function at level 1.
+static void stats_begin(lua_State *L, context *ctx, int function, stats_frame *saved)
+{
+    saved->site = ctx->site;
+    saved->active = ctx->active;
+    saved->start = ctx->start;
+
+    check_stats *site = NULL;
+    lua_Debug ar;
+    if (lua_getstack(L, 1, &ar))
     {
-        if (*p == '*')
+        lua_getinfo(L, "Sl", &ar);
+        lua_rawgetp(L, LUA_REGISTRYINDEX, &sites_key); // sites
+        if (ar.currentline > 0)
         {
-            luaL_addstring(b, "zero or more of ");
-            p++;
+            lua_pushfstring(L, "%s:%d", ar.short_src, ar.currentline); // sites key
         }
-        else if (*p == '+')
+        else
         {
-            luaL_addstring(b, "one or more of ");
-            p++;
+            lua_pushstring(L, ar.short_src); // sites key
+        }
+        lua_pushvalue(L, -1);                   // sites key key
+        if (lua_rawget(L, -3) == LUA_TUSERDATA) // sites key site
+        {
+            site = (check_stats *)lua_touserdata(L, -1);
+            lua_pop(L, 3);
+        }
+        else
+        {
+            lua_pop(L, 1);                                                  // sites key
+            site = (check_stats *)lua_newuserdata(L, sizeof(check_stats)); // sites key site
+            memset(site, 0, sizeof(check_stats));
+            lua_rawset(L, -3); // sites
+            lua_pop(L, 1);
         }
+        site->calls++;
     }
 
-    int n = 0;
-    if (*p == '?')
-    {
-        luaL_addstring(b, "nil");
-        p++;
-        n++;
-    }
-    for (const char *q = strchr(p, '|'); q != NULL; p = q + 1, q = strchr(p, '|'), n++)
-    {
-        if (n > 0) luaL_addstring(b, ", ");
-        append_descriptor0(b, p, (size_t)(q - p), is_option);
-    }
-    if (n > 0) luaL_addstring(b, n > 2 ? ", or " : " or ");
-    append_descriptor0(b, p, (size_t)(e - p), is_option);
+    ctx->site = site;
+    ctx->active = &ctx->functions[function];
+    ctx->active->calls++;
+    if (ctx->stats_mode == STATS_TIMING) ctx->start = stats_clock();
 }
 
-static void push_type_error(lua_State *L, int type, const char *expected, size_t expected_len)
+static void stats_add_time(context *ctx)
 {
-    luaL_Buffer b;
-    luaL_buffinit(L, &b);
-    append_descriptor(&b, expected, expected_len, false);
-    luaL_addstring(&b, " expected, got ");
-    luaL_addstring(&b, lua_typename(L, type));
-    luaL_pushresult(&b);
+    if (ctx->stats_mode != STATS_TIMING || ctx->active == NULL) return;
+    uint64_t elapsed = stats_clock() - ctx->start;
+    ctx->active->time += elapsed;
+    if (ctx->site != NULL) ctx->site->time += elapsed;
 }
 
-static void push_option_error(lua_State *L,                    //
-                              const char *got, size_t got_len, //
-                              const char *expected, size_t expected_len)
+// stops counting the running check, resuming the one it interrupted.
+static void stats_end(context *ctx, const stats_frame *saved)
 {
-    luaL_Buffer b;
-    luaL_buffinit(L, &b);
-    append_descriptor(&b, expected, expected_len, true);
-    luaL_addstring(&b, " expected, got '");
-    luaL_addlstring(&b, got, got_len);
-    luaL_addchar(&b, '\'');
-    luaL_pushresult(&b);
+    stats_add_time(ctx);
+    ctx->site = saved->site;
+    ctx->active = saved->active;
+    ctx->start = saved->start;
 }
 
-static bool options_match(lua_State *L,                    //
-                          const char *got, size_t got_len, //
-                          const char *expected, const char *expected_end)
+// counts the failure of the running check, about to raise an error.
+static void stats_failure(context *ctx)
 {
-    const char *p = expected;
-    const char *q = p;
-    while (p < expected_end)
-    {
-        q = (const char *)memchr(p, '|', (size_t)(expected_end - q));
-        if (q == NULL) q = expected_end;
-        if (str_leq(got, got_len, p, (size_t)(q - p))) return true;
-        p = q + 1;
-    }
-    return false;
+    if (ctx->active == NULL) return;
+    ctx->active->failures++;
+    if (ctx->site != NULL) ctx->site->failures++;
+    stats_add_time(ctx);
+    ctx->site = NULL;
+    ctx->active = NULL;
 }
 
-// must be called with the value to check at the top of the stack
-// the value is popped at the end
-static int options_check_one(lua_State *L, int level, int arg, const char *expected, size_t expected_len)
+// whether the running library function must be called again through stats_call.
+static inline bool stats_enter(context *ctx)
 {
-    // val
-    int type = lua_type(L, -1); // val
-
-    const char *p = expected;
-    const char *e = expected + expected_len;
-    if (*p == '?')
+    if (ctx->stats_mode == STATS_OFF) return false;
+    if (ctx->stats_entered)
     {
-        if (type == LUA_TNIL) return 1;
-        if (++p == e) return 0;
-    }
-
-    if (type != LUA_TSTRING)                                   // val
-    {                                                          //
-        lua_pop(L, 1);                                         //
-        push_type_error(L, type, "string", str_len("string")); // error
-        return errorL_argerror(L, level, arg, lua_tostring(L, -1));
+        ctx->stats_entered = false;
+        return false;
     }
+    return true;
+}
 
-    size_t got_len;
-    const char *got = lua_tolstring(L, -1, &got_len);
-    if (options_match(L, got, got_len, p, e))
-    {
-        lua_pop(L, 1);
-        return 1;
-    }
+// calls the library function `f` counting the check it performs.
+static int stats_call(lua_State *L, int function, lua_CFunction f)
+{
+    context *ctx = (context *)lua_touserdata(L, CONTEXT_INDEX);
+    stats_frame saved;
+    stats_begin(L, ctx, function, &saved);
+    ctx->stats_entered = true;
+    int n = f(L);
+    stats_end(ctx, &saved);
+    return n;
+}
 
-    push_option_error(L, got, got_len, expected, expected_len); // val error
-    lua_replace(L, -2);                                         // error
-    return errorL_argerror(L, level, arg, lua_tostring(L, -1));
+static void new_weak_table(lua_State *L, const char *mode)
+{
+    lua_newtable(L);          // t
+    lua_createtable(L, 0, 1); // t mt
+    lua_pushstring(L, mode);  // t mt mode
+    lua_setfield(L, -2, "__mode");
+    lua_setmetatable(L, -2); // t
 }
 
-/**
- * Checks whether an argument of the calling function is a string and its value is
- * any of the values specified in a given descriptor.
- *
- * Multiple values can be accepted if concatenated with a bar `|`:
- *
- *    check_option(1, 'one|two') -- accepts both `one` and `two`.
- *
- * A `nil` value can be accepted by prefixing the value descriptor with a
- * question mark:
- *
- *    check_option(1, '?one') -- matches 'one' or nil
- *
- * @function check_option
- * @tparam integer arg the position of the argument to be tested.
- * @tparam string expected the acceptable values descriptor.
- * @usage
- *    local function foo(mode)
- *      check_option(1, 'read|write')
- *      ...
- * @raise If the descriptor is `nil` or empty; or if the argument position is invalid.
- */
-static int checks_check_option(lua_State *L)
+// whether `source` is the chunk name of the file of the module `name`, ending with `suffix`.
+static bool source_is_module_file(const char *source, size_t source_len, //
+                                  const char *name, size_t name_len,     //
+                                  const char *suffix, size_t suffix_len)
 {
-    int arg = (int)luaL_checkinteger(L, 1);
-    size_t expected_len;
-    const char *expected = luaL_checklstring(L, 2, &expected_len);
-    if (expected_len == 0)
-    {
-        return luaL_argerror(L, 2, "empty descriptor");
-    }
-    int level = (int)luaL_optinteger(L, 3, 1);
+    if (source_len < name_len + suffix_len + 1) return false;
 
-    lua_Debug ar;
-    lua_getstack(L, 1, &ar);
-    if (!lua_getlocal(L, &ar, arg))
+    const char *p = source + source_len - suffix_len;
+    if (memcmp(p, suffix, suffix_len) != 0) return false;
+
+    p -= name_len;
+    for (size_t i = 0; i < name_len; i++)
     {
-        return luaL_argerror(L, 1, "invalid argument index");
+        if (name[i] == '.')
+        {
+            if (p[i] != '/' && p[i] != '\\') return false;
+        }
+        else if (p[i] != name[i])
+        {
+            return false;
+        }
     }
-
-    // val
-    if (options_check_one(L, level, arg, expected, expected_len)) return 0;
-    return luaL_argerror(L, 2, "invalid descriptor");
+    return p[-1] == '@' || p[-1] == '/' || p[-1] == '\\';
 }
 
-static bool type_match_one_fast(int type, const char *expected, size_t expected_len, bool *is_match)
+static bool source_is_module(const char *source, const char *name, size_t name_len)
 {
-    if (type != LUA_TNIL && str_eq(expected, expected_len, "any"))
-    {
-        *is_match = true;
-        return true;
-    }
+    size_t source_len = strlen(source);
+    return source_is_module_file(source, source_len, name, name_len, ".lua", str_len(".lua"))
+        || source_is_module_file(source, source_len, name, name_len, "/init.lua", str_len("/init.lua"));
+}
 
-    if (type == LUA_TNUMBER && str_eq(expected, expected_len, "number"))
+// returns the check level applying to the function at the top of the stack, and pops the function.
+static int resolve_check_level(lua_State *L, int ctx)
+{
+    // fn
+    lua_getuservalue(L, ctx);              // fn uv
+    lua_rawgeti(L, -1, CONTEXT_FUNCTIONS); // fn uv functions
+    lua_pushvalue(L, -3);                  // fn uv functions fn
+    if (lua_rawget(L, -2) == LUA_TNUMBER)  // fn uv functions level
     {
-        *is_match = true;
-        return true;
+        int check_level = (int)lua_tointeger(L, -1);
+        lua_pop(L, 4);
+        return check_level;
     }
+    lua_pop(L, 1); // fn uv functions
 
-    switch (type)
-    {
-        case LUA_TBOOLEAN:
-            *is_match = str_eq(expected, expected_len, "boolean");
-            return true;
-        case LUA_TSTRING:
-            *is_match = str_eq(expected, expected_len, "string");
-            return true;
-        case LUA_TFUNCTION:
-            *is_match = str_eq(expected, expected_len, "function");
-            return true;
-        case LUA_TTHREAD:
-            *is_match = str_eq(expected, expected_len, "thread");
-            return true;
-    }
+    int check_level = ((const context *)lua_touserdata(L, ctx))->check_level;
 
-    if (type == LUA_TUSERDATA || type == LUA_TLIGHTUSERDATA)
+    lua_Debug ar;
+    lua_pushvalue(L, -3);                // fn uv functions fn
+    lua_getinfo(L, ">S", &ar);           // fn uv functions
+    lua_rawgeti(L, -2, CONTEXT_MODULES); // fn uv functions modules
+    lua_pushnil(L);                      // fn uv functions modules nil
+    while (lua_next(L, -2))              // fn uv functions modules name level
     {
-        if (str_eq(expected, expected_len, "userdata"))
+        size_t name_len;
+        const char *name = lua_tolstring(L, -2, &name_len);
+        if (source_is_module(ar.source, name, name_len))
         {
-            *is_match = true;
-            return true;
+            check_level = (int)lua_tointeger(L, -1);
+            lua_pop(L, 2); // fn uv functions modules
+            break;
         }
+        lua_pop(L, 1); // fn uv functions modules name
     }
-    return false;
+    lua_pop(L, 1);                   // fn uv functions
+    lua_pushvalue(L, -3);            // fn uv functions fn
+    lua_pushinteger(L, check_level); // fn uv functions fn level
+    lua_rawset(L, -3);               // fn uv functions
+    lua_pop(L, 3);
+    return check_level;
 }
 
-static bool type_match_one_slow(lua_State *L, int type,          //
-                                const char *got, size_t got_len, //
-                                const char *expected, size_t expected_len)
+// returns the check level applying to the calling function.
+static int get_check_level(lua_State *L, int ctx)
 {
-    if (str_leq(got, got_len, expected, expected_len)) return true;
+    const context *c = (const context *)lua_touserdata(L, ctx);
+    if (c->module_count == 0) return c->check_level;
 
-    if (type == LUA_TUSERDATA && str_eq(expected, expected_len, "file"))
+    lua_Debug ar;
+    if (!lua_getstack(L, 1, &ar)) return c->check_level;
+    lua_getinfo(L, "f", &ar); // fn
+    return resolve_check_level(L, ctx);
+}
+
+// returns the sampling rate applying to the function at the top of the stack, without popping it.
+static int resolve_sampling(lua_State *L, int ctx)
+{
+    // fn
+    lua_getuservalue(L, ctx);             // fn uv
+    lua_rawgeti(L, -1, CONTEXT_SAMPLED);  // fn uv sampled
+    lua_pushvalue(L, -3);                 // fn uv sampled fn
+    if (lua_rawget(L, -2) == LUA_TNUMBER) // fn uv sampled n
     {
-        return str_leq(LUA_FILEHANDLE, str_len(LUA_FILEHANDLE), got, got_len);
+        int n = (int)lua_tointeger(L, -1);
+        lua_pop(L, 3);
+        return n;
     }
+    lua_pop(L, 1); // fn uv sampled
 
-    if (checkers_ref == LUA_NOREF) return false;
+    int n = ((const context *)lua_touserdata(L, ctx))->sampling;
 
-    lua_pushlstring(L, expected, expected_len); // val checkers expected
-    if (!lua_gettable(L, -2))
+    lua_rawgeti(L, -2, CONTEXT_SAMPLING); // fn uv sampled sampling
+    lua_pushvalue(L, -4);                 // fn uv sampled sampling fn
+    if (lua_rawget(L, -2) == LUA_TNUMBER) // fn uv sampled sampling n
     {
-        lua_pop(L, 1); // val checkers
+        n = (int)lua_tointeger(L, -1);
     }
-    else // val checkers checker
+    else
     {
-        if (lua_isfunction(L, -1))
+        lua_Debug ar;
+        lua_pushvalue(L, -5);      // fn uv sampled sampling nil fn
+        lua_getinfo(L, ">S", &ar); // fn uv sampled sampling nil
+        lua_pushnil(L);            // fn uv sampled sampling nil nil
+        while (lua_next(L, -3))    // fn uv sampled sampling nil name n
         {
-            lua_pushvalue(L, -3); // val checkers checker val
-            lua_call(L, 1, 1);    // val checkers result
-            if (lua_toboolean(L, -1))
+            size_t name_len;
+            const char *name = lua_type(L, -2) == LUA_TSTRING ? lua_tolstring(L, -2, &name_len) : NULL;
+            if (name != NULL && source_is_module(ar.source, name, name_len))
             {
-                lua_pop(L, 1); // val checkers
-                return true;
+                n = (int)lua_tointeger(L, -1);
+                lua_pop(L, 2); // fn uv sampled sampling nil
+                break;
             }
+            lua_pop(L, 1); // fn uv sampled sampling nil name
         }
-        lua_pop(L, 1); // val checkers
     }
-    return false;
+    lua_pop(L, 2);         // fn uv sampled
+    lua_pushvalue(L, -3);  // fn uv sampled fn
+    lua_pushinteger(L, n); // fn uv sampled fn n
+    lua_rawset(L, -3);     // fn uv sampled
+    lua_pop(L, 2);         // fn
+    return n;
 }
 
-// must be called with the value to check at the top of the stack
-// the value is popped at the end
-static bool type_match(lua_State *L, int type, const char *expected, const char *expected_end)
+// returns whether the check of the argument `arg` performed by the calling function, against the
+// descriptor at index `desc`, is sampled out; the call site is identified by the calling function,
+// the argument and the descriptor. `arg` is 0 for the checks of all the arguments.
+static bool sample_skip(lua_State *L, int ctx, int desc, int arg)
 {
-    // value
-    size_t got_len;
-    const char *got = NULL;
+    context *c = (context *)lua_touserdata(L, ctx);
+    lua_Debug ar;
+    if (!lua_getstack(L, 1, &ar)) return false;
+    lua_getinfo(L, "f", &ar); // fn
 
-    const char *p = expected;
-    const char *q = p;
-    while (p < expected_end)
-    {
-        q = (const char *)memchr(p, '|', (size_t)(expected_end - q));
-        if (q == NULL) q = expected_end;
+    int n = c->sampling_count > 0 ? resolve_sampling(L, ctx) : c->sampling;
+    uintptr_t site = (uintptr_t)lua_topointer(L, -1) ^ ((uintptr_t)lua_tostring(L, desc) >> 3);
+    site ^= (uintptr_t)(unsigned)arg * 0x9E3779B1u;
+    lua_pop(L, 1);
+    if (n <= 1) return false;
 
-        bool is_match;
-        if (type_match_one_fast(type, p, (size_t)(q - p), &is_match))
-        {
-            lua_pop(L, 1);
-            return is_match;
-        }
+    uint32_t *counter = &c->samples[((uint32_t)(site ^ (site >> 16)) * 2654435761u) >> (32 - SAMPLE_BITS)];
+    return (*counter)++ % (uint32_t)n != 0;
+}
 
-        if (got == NULL)
-        {
-            got = get_specific_type(L, type, &got_len);
-            if (checkers_ref != LUA_NOREF)
-            {
-                lua_geti(L, LUA_REGISTRYINDEX, checkers_ref); // checkers
-            }
-        }
+// returns the string field `field_name` of the metatable of the value at index `arg`;
+// the field is looked up once per metatable and cached in the weak table at registry key `cache_key`.
+static const char *get_meta_field(lua_State *L, int arg, const void *cache_key, const char *field_name, size_t *len)
+{
+    if (!lua_getmetatable(L, arg)) return NULL; // mt
 
-        if (type_match_one_slow(L, type, got, got_len, p, (size_t)(q - p)))
+#ifdef CHECKS_NO_NAME_CACHE
+    // the lookup the cache saves, for measuring it (see `make bench-names`)
+    (void)cache_key;
+    lua_pushstring(L, field_name); // mt field_name
+    const char *field = lua_rawget(L, -2) == LUA_TSTRING ? lua_tolstring(L, -1, len) : NULL; // mt value
+    lua_pop(L, 2);
+    return field;
+#else
+    lua_rawgetp(L, LUA_REGISTRYINDEX, cache_key); // mt cache
+    lua_pushvalue(L, -2);                         // mt cache mt
+    int field_type = lua_rawget(L, -2);           // mt cache value
+    if (field_type == LUA_TNIL)
+    {
+        lua_pop(L, 1);                  // mt cache
+        lua_pushstring(L, field_name);  // mt cache field_name
+        field_type = lua_rawget(L, -3); // mt cache value
+        if (field_type != LUA_TSTRING)
         {
-            lua_pop(L, checkers_ref == LUA_NOREF ? 1 : 2);
-            return true;
+            lua_pop(L, 1);         // mt cache
+            lua_pushboolean(L, 0); // mt cache false
         }
-        p = q + 1;
+        lua_pushvalue(L, -3); // mt cache value mt
+        lua_pushvalue(L, -2); // mt cache value mt value
+        lua_rawset(L, -4);    // mt cache value
     }
 
-    lua_pop(L, checkers_ref == LUA_NOREF ? 1 : 2);
-    return false;
+    const char *value = NULL;
+    if (field_type == LUA_TSTRING)
+    {
+        value = lua_tolstring(L, -1, len);
+    }
+    lua_pop(L, 3);
+    return value;
+#endif
 }
 
-// must be called with the value to check at the top of the stack
-// the value is popped at the end
-static int type_check_one(lua_State *L, int level, int arg, const char *expected, size_t expected_len)
+static const char *get_specific_type(lua_State *L, int arg, int type, size_t *len)
 {
-    // val
-    if (*expected == ':')
+    if (type == LUA_TNUMBER)
     {
-        if (--expected_len == 0) return 0;
-        return options_check_one(L, level, arg, ++expected, expected_len);
+        if (lua_isinteger(L, arg))
+        {
+            *len = str_len("integer");
+            return "integer";
+        }
+        *len = str_len("float");
+        return "float";
     }
 
+    const char *name = NULL;
+    if (type == LUA_TUSERDATA)
+    {
+        name = get_meta_field(L, arg, &userdata_names_key, "__name", len);
+    }
+    else if (type == LUA_TTABLE)
+    {
+        name = get_meta_field(L, arg, &table_names_key, "__type", len);
+    }
+    if (name == NULL)
+    {
+        name = lua_typename(L, type);
+        *len = strlen(name);
+    }
+    return name;
+}
+
+static unsigned str_hash(const char *s, size_t len)
+{
+    unsigned h = 2166136261u;
+    for (size_t i = 0; i < len; i++)
+    {
+        h = (h ^ (unsigned char)s[i]) * 16777619u;
+    }
+    return h;
+}
+
+static native_checkers *natives_new(lua_State *L, size_t capacity)
+{
+    native_checkers *natives = (native_checkers *)lua_newuserdata(L, sizeof(native_checkers)
+                                                                         + capacity * sizeof(native_checker));
+    natives->capacity = capacity;
+    natives->count = 0;
+    memset(natives->slots, 0, capacity * sizeof(native_checker));
+    return natives;
+}
+
+static native_checker *natives_find(native_checkers *natives, const char *name, size_t len, unsigned hash)
+{
+    size_t mask = natives->capacity - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask)
+    {
+        native_checker *slot = &natives->slots[i];
+        if (slot->name == NULL) return slot;
+        if (slot->hash == hash && str_leq(slot->name, slot->len, name, len)) return slot;
+    }
+}
+
+// returns the predicate registered as the native check `name`, or NULL.
+static ldk_checks_predicate natives_get(lua_State *L, const char *name, size_t len)
+{
+    lua_rawgetp(L, LUA_REGISTRYINDEX, &natives_key); // natives
+    native_checkers *natives = (native_checkers *)lua_touserdata(L, -1);
+    lua_pop(L, 1);
+    return natives_find(natives, name, len, str_hash(name, len))->predicate;
+}
+
+static void natives_register(lua_State *L, const char *name, ldk_checks_predicate predicate, void *ud)
+{
+    size_t len = strlen(name);
+    unsigned hash = str_hash(name, len);
+
+    lua_rawgetp(L, LUA_REGISTRYINDEX, &natives_key); // natives
+    native_checkers *natives = (native_checkers *)lua_touserdata(L, -1);
+    native_checker *slot = natives_find(natives, name, len, hash);
+    if (slot->name == NULL && predicate != NULL)
+    {
+        if (2 * (natives->count + 1) > natives->capacity)
+        {
+            native_checkers *grown = natives_new(L, 2 * natives->capacity); // natives grown
+            for (size_t i = 0; i < natives->capacity; i++)
+            {
+                native_checker *old = &natives->slots[i];
+                if (old->name != NULL) *natives_find(grown, old->name, old->len, old->hash) = *old;
+            }
+            grown->count = natives->count;
+            lua_getuservalue(L, -2); // natives grown names
+            lua_setuservalue(L, -2); // natives grown
+            lua_pushvalue(L, -1);    // natives grown grown
+            lua_rawsetp(L, LUA_REGISTRYINDEX, &natives_key);
+            lua_remove(L, -2); // grown
+            natives = grown;
+            slot = natives_find(natives, name, len, hash);
+        }
+
+        lua_getuservalue(L, -1);                 // natives names
+        lua_pushlstring(L, name, len);           // natives names name
+        slot->name = lua_tolstring(L, -1, NULL); //
+        lua_pushboolean(L, 1);                   // natives names name true
+        lua_rawset(L, -3);                       // natives names
+        lua_pop(L, 1);                           // natives
+        slot->hash = hash;
+        slot->len = len;
+        natives->count++;
+    }
+    if (slot->name != NULL)
+    {
+        slot->predicate = predicate;
+        slot->ud = ud;
+    }
+    lua_pop(L, 1);
+}
+
+static bool check_callable(lua_State *L, int idx, void *ud)
+{
+    (void)ud;
+    if (lua_type(L, idx) == LUA_TFUNCTION) return true;
+    if (luaL_getmetafield(L, idx, "__call") == LUA_TNIL) return false;
+    lua_pop(L, 1);
+    return true;
+}
+
+static bool check_nonempty(lua_State *L, int idx, void *ud)
+{
+    (void)ud;
+    switch (lua_type(L, idx))
+    {
+        case LUA_TSTRING:
+            return lua_rawlen(L, idx) > 0;
+        case LUA_TTABLE:
+            lua_pushnil(L);
+            if (!lua_next(L, idx)) return false;
+            lua_pop(L, 2);
+            return true;
+    }
+    return false;
+}
+
+static bool check_positive(lua_State *L, int idx, void *ud)
+{
+    (void)ud;
+    if (lua_type(L, idx) != LUA_TNUMBER) return false;
+    if (lua_isinteger(L, idx)) return lua_tointeger(L, idx) > 0;
+    return lua_tonumber(L, idx) > 0;
+}
+
+static bool check_array(lua_State *L, int idx, void *ud)
+{
+    (void)ud;
+    if (lua_type(L, idx) != LUA_TTABLE) return false;
+
+    lua_Integer n = (lua_Integer)lua_rawlen(L, idx);
+    lua_Integer count = 0;
+    lua_pushnil(L);          // nil
+    while (lua_next(L, idx)) // k v
+    {
+        lua_pop(L, 1); // k
+        lua_Integer k = lua_isinteger(L, -1) ? lua_tointeger(L, -1) : 0;
+        if (k < 1 || k > n)
+        {
+            lua_pop(L, 1);
+            return false;
+        }
+        count++;
+    }
+    return count == n;
+}
+
+static bool check_ascii(lua_State *L, int idx, void *ud)
+{
+    (void)ud;
+    if (lua_type(L, idx) != LUA_TSTRING) return false;
+    size_t len;
+    const char *s = lua_tolstring(L, idx, &len);
+    return textL_isascii(s, len);
+}
+
+static bool check_utf8(lua_State *L, int idx, void *ud)
+{
+    (void)ud;
+    if (lua_type(L, idx) != LUA_TSTRING) return false;
+    size_t len;
+    const char *s = lua_tolstring(L, idx, &len);
+    return textL_isutf8(s, len);
+}
+
+static bool check_printable(lua_State *L, int idx, void *ud)
+{
+    (void)ud;
+    if (lua_type(L, idx) != LUA_TSTRING) return false;
+    size_t len;
+    const char *s = lua_tolstring(L, idx, &len);
+    return textL_isprintable(s, len);
+}
+
+static unsigned descriptor_type_bits(const char *p, size_t len)
+{
+    switch (*p)
+    {
+        case 'a':
+            if (str_eq(p, len, "any")) return DESC_ANY;
+            break;
+        case 'b':
+            if (str_eq(p, len, "boolean")) return TYPE_BIT(LUA_TBOOLEAN);
+            break;
+        case 'f':
+            if (str_eq(p, len, "function")) return TYPE_BIT(LUA_TFUNCTION);
+            if (str_eq(p, len, "float")) return DESC_FLOAT;
+            if (str_eq(p, len, "file")) return DESC_FILE;
+            break;
+        case 'i':
+            if (str_eq(p, len, "integer")) return DESC_INTEGER;
+            break;
+        case 'n':
+            if (str_eq(p, len, "number")) return TYPE_BIT(LUA_TNUMBER);
+            if (str_eq(p, len, "nil")) return TYPE_BIT(LUA_TNIL);
+            break;
+        case 's':
+            if (str_eq(p, len, "string")) return TYPE_BIT(LUA_TSTRING);
+            break;
+        case 't':
+            if (str_eq(p, len, "table")) return TYPE_BIT(LUA_TTABLE);
+            if (str_eq(p, len, "thread")) return TYPE_BIT(LUA_TTHREAD);
+            break;
+        case 'u':
+            if (str_eq(p, len, "userdata")) return DESC_USERDATA;
+            break;
+    }
+    return 0;
+}
+
+// returns the end of the alternative starting at `p`: the first `|` not within braces, or `e`.
+static const char *alternative_end(const char *p, const char *e)
+{
+    int depth = 0;
+    for (; p < e; p++)
+    {
+        if (*p == '{')
+        {
+            depth++;
+        }
+        else if (*p == '}')
+        {
+            depth--;
+        }
+        else if (*p == '|' && depth == 0)
+        {
+            break;
+        }
+    }
+    return p;
+}
+
+static void push_descriptors(lua_State *L)
+{
+    lua_rawgetp(L, LUA_REGISTRYINDEX, &descriptors_key); // descriptors
+}
+
+static const descriptor *descriptor_push(lua_State *L, int cache, int arg, bool keep);
+
+// the largest `:n` limit of an array descriptor
+#define ARRAY_LIMIT_MAX INT_MAX
+
+// compiles the `{...}` alternative between `p` and `e`, returning the descriptor of its elements
+// and pushing it, unless it is invalid.
+static const descriptor *element_compile(lua_State *L, const char *p, const char *e, lua_Integer *limit)
+{
+    if (e - p < 3 || e[-1] != '}') return NULL;
+    p++;
+    e--;
+
+    // an optional `:n` suffix limits the check to the first n elements
+    *limit = 0;
+    const char *q = e;
+    while (q > p && isdigit((unsigned char)q[-1])) q--;
+    if (q < e && q - p > 1 && q[-1] == ':')
+    {
+        for (const char *r = q; r < e; r++)
+        {
+            int digit = *r - '0';
+            if (*limit > (ARRAY_LIMIT_MAX - digit) / 10) return NULL;
+            *limit = *limit * 10 + digit;
+        }
+        if (*limit == 0) return NULL;
+        e = q - 1;
+    }
+
+    push_descriptors(L);                                      // descriptors
+    lua_pushlstring(L, p, (size_t)(e - p));                   // descriptors text
+    const descriptor *d = descriptor_push(L, -2, -1, false); // descriptors text [element]
+    if (d == NULL)
+    {
+        lua_pop(L, 2);
+        return NULL;
+    }
+    lua_replace(L, -3); // element text
+    lua_pop(L, 1);      // element
+    return d->repeat ? NULL : d;
+}
+
+// option sets with at least this many options are hashed
+#define OPTIONS_HASH_MIN 8
+
+// returns the type of the alternative between `p` and `e` if it has a `[min,max]` suffix, setting
+// `*bracket` to the start of the suffix; returns 0 otherwise.
+static unsigned alternative_bound(const char *p, const char *e, const char **bracket)
+{
+    if (e - p < 4 || e[-1] != ']') return 0;
+    const char *q = (const char *)memchr(p, '[', (size_t)(e - p));
+    if (q == NULL || q == p) return 0;
+    unsigned bit = descriptor_type_bits(p, (size_t)(q - p));
+    if (bit == 0 || (bit & ~DESC_BOUNDABLE) != 0) return 0;
+    *bracket = q;
+    return bit;
+}
+
+// parses a bound between `p` and `e`; sets `*has` to false if the bound is omitted.
+static bool bound_parse_one(const char *p, const char *e, bool is_float, bool *has, lua_Integer *i, lua_Number *f)
+{
+    *has = p < e;
+    if (!*has) return true;
+    if (isspace((unsigned char)*p)) return false;
+
+    char *end;
+    errno = 0;
+    if (is_float)
+    {
+        double value = strtod(p, &end);
+        if (value != value) return false;
+        // an underflow rounds to zero or a subnormal, which is still a valid bound
+        if (errno == ERANGE && (value == HUGE_VAL || value == -HUGE_VAL)) return false;
+        *f = (lua_Number)value;
+    }
+    else
+    {
+        long long value = strtoll(p, &end, 10);
+        if (errno == ERANGE) return false;
+        *i = (lua_Integer)value;
+    }
+    return end == e;
+}
+
+// parses the `[min,max]` suffix between `p` and `e` of an alternative of type `bit`.
+static bool bound_parse(const char *p, const char *e, unsigned bit, type_bound *bound)
+{
+    const char *comma = (const char *)memchr(p, ',', (size_t)(e - p));
+    if (comma == NULL) return false;
+
+    bool is_float = bit == TYPE_BIT(LUA_TNUMBER) || bit == DESC_FLOAT;
+    bound->bit = bit;
+    if (!bound_parse_one(p + 1, comma, is_float, &bound->has_min, &bound->min, &bound->fmin)) return false;
+    if (!bound_parse_one(comma + 1, e - 1, is_float, &bound->has_max, &bound->max, &bound->fmax)) return false;
+    if (!bound->has_min && !bound->has_max) return false;
+    if (is_float) return !bound->has_min || !bound->has_max || bound->fmin <= bound->fmax;
+
+    // lengths are not negative
+    bool is_length = bit == TYPE_BIT(LUA_TSTRING) || bit == TYPE_BIT(LUA_TTABLE);
+    if (is_length && ((bound->has_min && bound->min < 0) || (bound->has_max && bound->max < 0))) return false;
+    return !bound->has_min || !bound->has_max || bound->min <= bound->max;
+}
+
+// compiles a descriptor into a new userdata pushed on the top of the stack, above the descriptor of
+// its elements if it has one; returns NULL if the descriptor is invalid.
+static descriptor *descriptor_build(lua_State *L, const char *text, size_t text_len)
+{
+    const char *p = text;
+    const char *e = text + text_len;
+
+    char repeat = 0;
+    if (p < e && (*p == '*' || *p == '+')) repeat = *p++;
+
+    const char *body = p;
+    bool is_option = p < e && *p == ':';
+    if (is_option) p++;
+
+    unsigned mask = 0;
+    if (p < e && *p == '?')
+    {
+        mask |= TYPE_BIT(LUA_TNIL);
+        p++;
+    }
+    if (p == e) return NULL;
+
+    int name_count = 0;
+    const descriptor *element = NULL;
+    lua_Integer limit = 0;
+    int bound_count = 0;
+    type_bound bounds[BOUNDS_MAX];
+    for (const char *q = p; q <= e; q++)
+    {
+        const char *r = is_option ? (const char *)memchr(q, '|', (size_t)(e - q)) : alternative_end(q, e);
+        if (r == NULL) r = e;
+        if (r == q) return NULL;
+        const char *bracket;
+        unsigned bit;
+        if (is_option)
+        {
+            name_count++;
+        }
+        else if (*q == '{')
+        {
+            if (element != NULL) return NULL;
+            element = element_compile(L, q, r, &limit);
+            if (element == NULL) return NULL;
+        }
+        else if ((bit = alternative_bound(q, r, &bracket)) != 0)
+        {
+            // a type is bounded at most once
+            for (int i = 0; i < bound_count; i++)
+            {
+                if (bounds[i].bit == bit) return NULL;
+            }
+            if (!bound_parse(bracket, r, bit, &bounds[bound_count])) return NULL;
+            bound_count++;
+        }
+        else if (descriptor_type_bits(q, (size_t)(r - q)) == 0)
+        {
+            name_count++;
+        }
+        q = r;
+    }
+
+    // large option sets are looked up in a hash table with at most 50% load
+    unsigned slot_count = 0;
+    if (is_option && name_count >= OPTIONS_HASH_MIN)
+    {
+        for (slot_count = 1; slot_count < 2 * (unsigned)name_count;) slot_count *= 2;
+    }
+
+    size_t bounds_size = (size_t)bound_count * sizeof(type_bound);
+    size_t names_size = (size_t)name_count * sizeof(type_name);
+    size_t slots_size = slot_count * sizeof(int);
+    descriptor *d = (descriptor *)lua_newuserdata(L, sizeof(descriptor) + bounds_size + names_size + slots_size + text_len + 1);
+    type_bound *bounds_copy = (type_bound *)(d + 1);
+    type_name *names = (type_name *)((char *)bounds_copy + bounds_size);
+    int *slots = (int *)((char *)names + names_size);
+    char *copy = (char *)slots + slots_size;
+    memcpy(copy, text, text_len);
+    copy[text_len] = '\0';
+
+    d->repeat = repeat;
+    d->is_option = is_option;
+    d->name_count = 0;
+    d->names = names;
+    d->text = copy;
+    d->text_len = text_len;
+    d->body = copy + (body - text);
+    d->body_len = (size_t)(e - body);
+    d->element = element;
+    d->limit = limit;
+    d->slow_hits = 0;
+    d->checker_calls = 0;
+    d->forced = false;
+    d->option_slots = NULL;
+    d->option_mask = 0;
+    d->bound_count = bound_count;
+    d->bounds = bounds_copy;
+    if (bound_count > 0) memcpy(bounds_copy, bounds, bounds_size);
+
+    p = copy + (p - text);
+    e = copy + text_len;
+    if (is_option)
+    {
+        for (const char *q = p; q < e; q++)
+        {
+            const char *r = (const char *)memchr(q, '|', (size_t)(e - q));
+            if (r == NULL) r = e;
+            names[d->name_count].name = q;
+            names[d->name_count].len = (size_t)(r - q);
+            names[d->name_count].hash = str_hash(q, (size_t)(r - q));
+            d->name_count++;
+            q = r;
+        }
+        if (slot_count > 0)
+        {
+            memset(slots, 0xff, slots_size);
+            for (int i = 0; i < d->name_count; i++)
+            {
+                unsigned j = names[i].hash & (slot_count - 1);
+                while (slots[j] >= 0) j = (j + 1) & (slot_count - 1);
+                slots[j] = i;
+            }
+            d->option_slots = slots;
+            d->option_mask = slot_count - 1;
+        }
+    }
+    else
+    {
+        for (const char *q = p; q < e; q++)
+        {
+            const char *r = alternative_end(q, e);
+            const char *bracket;
+            if (*q != '{' && alternative_bound(q, r, &bracket) != 0)
+            {
+                q = r;
+                continue;
+            }
+            unsigned bits = *q == '{' ? DESC_ARRAY : descriptor_type_bits(q, (size_t)(r - q));
+            if (bits == 0)
+            {
+                names[d->name_count].name = q;
+                names[d->name_count].len = (size_t)(r - q);
+                names[d->name_count].hash = str_hash(q, (size_t)(r - q));
+                d->name_count++;
+            }
+            mask |= bits;
+            q = r;
+        }
+    }
+    d->mask = mask;
+    return d;
+}
+
+// compiles a descriptor into a new userdata pushed on the top of the stack;
+// returns NULL, and pushes nothing, if the descriptor is invalid.
+static descriptor *descriptor_compile(lua_State *L, const char *text, size_t text_len)
+{
+    int top = lua_gettop(L);
+    descriptor *d = descriptor_build(L, text, text_len); // [element] [d]
+    if (d == NULL)
+    {
+        lua_settop(L, top);
+        return NULL;
+    }
+    if (lua_gettop(L) > top + 1)
+    {
+        // the descriptor of the elements may not be cached
+        lua_insert(L, -2);       // d element
+        lua_setuservalue(L, -2); // d
+    }
+
+    lua_rawgetp(L, LUA_REGISTRYINDEX, &descriptor_refs_key); // d refs
+    lua_pushvalue(L, -2);                                    // d refs d
+    lua_rawsetp(L, -2, d);                                   // d refs
+    lua_pop(L, 1);                                           // d
+    return d;
+}
+
+// the descriptors compiled past this many are not cached
+#define DESCRIPTORS_MAX 4096
+
+// pushes the compiled form of the descriptor string at index `arg`, compiling it on first use;
+// returns NULL, pushing nothing, if the descriptor is invalid. `cache` is the index of the
+// descriptor cache; with `keep`, the descriptor is cached even past DESCRIPTORS_MAX.
+static const descriptor *descriptor_push(lua_State *L, int cache, int arg, bool keep)
+{
+    cache = lua_absindex(L, cache);
+    arg = lua_absindex(L, arg);
+
+    lua_pushvalue(L, arg);                     // text
+    if (lua_rawget(L, cache) == LUA_TUSERDATA) // descriptor
+    {
+        return (const descriptor *)lua_touserdata(L, -1);
+    }
+    lua_pop(L, 1);
+
+    size_t text_len;
+    const char *text = lua_tolstring(L, arg, &text_len);
+    descriptor *d = descriptor_compile(L, text, text_len); // descriptor
+    if (d == NULL) return NULL;
+    context *ctx = get_state_context(L);
+    if (keep || ctx->descriptor_count < DESCRIPTORS_MAX)
+    {
+        ctx->descriptor_count++;
+        lua_pushvalue(L, arg); // descriptor text
+        lua_pushvalue(L, -2);  // descriptor text descriptor
+        lua_rawset(L, cache);  // descriptor
+    }
+    return d;
+}
+
+static inline void append_descriptor0(luaL_Buffer *b, const char *p, size_t len, bool is_option)
+{
+    if (is_option)
+    {
+        luaL_addchar(b, '\'');
+        luaL_addlstring(b, p, len);
+        luaL_addchar(b, '\'');
+    }
+    else if (str_eq(p, len, "any"))
+    {
+        luaL_addstring(b, "anything but nil");
+    }
+    else
+    {
+        luaL_addlstring(b, p, len);
+    }
+}
+
+static const char *next_bar(const char *p, const char *e, bool is_option)
+{
+    if (!is_option) return alternative_end(p, e);
+    const char *q = (const char *)memchr(p, '|', (size_t)(e - p));
+    return q == NULL ? e : q;
+}
+
+static void append_descriptor(luaL_Buffer *b, const char *descriptor, size_t descriptor_len, bool is_option)
+{
+    const char *p = descriptor;
+    const char *e = descriptor + descriptor_len;
+
+    if (!is_option)
+    {
+        if (*p == '*')
+        {
+            luaL_addstring(b, "zero or more of ");
+            p++;
+        }
+        else if (*p == '+')
+        {
+            luaL_addstring(b, "one or more of ");
+            p++;
+        }
+    }
+
+    int n = 0;
+    if (*p == '?')
+    {
+        luaL_addstring(b, "nil");
+        p++;
+        n++;
+    }
+    for (const char *q = next_bar(p, e, is_option); q < e; p = q + 1, q = next_bar(p, e, is_option), n++)
+    {
+        if (n > 0) luaL_addstring(b, ", ");
+        append_descriptor0(b, p, (size_t)(q - p), is_option);
+    }
+    if (n > 0) luaL_addstring(b, n > 2 ? ", or " : " or ");
+    append_descriptor0(b, p, (size_t)(e - p), is_option);
+}
+
+static void push_type_error(lua_State *L, int type, const char *expected, size_t expected_len)
+{
+    luaL_Buffer b;
+    luaL_buffinit(L, &b);
+    append_descriptor(&b, expected, expected_len, false);
+    luaL_addstring(&b, " expected, got ");
+    luaL_addstring(&b, lua_typename(L, type));
+    luaL_pushresult(&b);
+}
+
+static void push_option_error(lua_State *L,                    //
+                              const char *got, size_t got_len, //
+                              const char *expected, size_t expected_len)
+{
+    luaL_Buffer b;
+    luaL_buffinit(L, &b);
+    append_descriptor(&b, expected, expected_len, true);
+    luaL_addstring(&b, " expected, got '");
+    luaL_addlstring(&b, got, got_len);
+    luaL_addchar(&b, '\'');
+    luaL_pushresult(&b);
+}
+
+static void type_check_one(lua_State *L, int check_level, int level, int arg, const descriptor *d, int idx);
+static bool push_schema_error(lua_State *L, const descriptor *d, int idx);
+
+// returns whether `got` is one of the options of a compiled option descriptor.
+static bool options_find(const descriptor *d, const char *got, size_t got_len)
+{
+    if (d->option_slots == NULL)
+    {
+        for (int i = 0; i < d->name_count; i++)
+        {
+            if (str_leq(got, got_len, d->names[i].name, d->names[i].len)) return true;
+        }
+        return false;
+    }
+
+    unsigned hash = str_hash(got, got_len);
+    for (unsigned j = hash & d->option_mask; d->option_slots[j] >= 0; j = (j + 1) & d->option_mask)
+    {
+        const type_name *name = &d->names[d->option_slots[j]];
+        if (name->hash == hash && str_leq(got, got_len, name->name, name->len)) return true;
+    }
+    return false;
+}
+
+// maximum number of cached option descriptors; the others are compiled on each use.
+#define OPTIONS_MAX 1024
+
+// pushes the compiled form of the options at index `arg`, compiling them on first use; returns
+// NULL, pushing nothing, if they are invalid. With `keep`, the options are cached even past
+// OPTIONS_MAX.
+static const descriptor *options_push(lua_State *L, context *ctx, int arg, bool keep)
+{
+    arg = lua_absindex(L, arg);
+    lua_rawgetp(L, LUA_REGISTRYINDEX, &options_key); // options
+    lua_pushvalue(L, arg);                           // options expected
+    if (lua_rawget(L, -2) == LUA_TUSERDATA)          // options descriptor
+    {
+        lua_remove(L, -2); // descriptor
+        return (const descriptor *)lua_touserdata(L, -1);
+    }
+    lua_pop(L, 1); // options
+
+    lua_pushliteral(L, ":"); // options ":"
+    lua_pushvalue(L, arg);   // options ":" expected
+    lua_concat(L, 2);        // options text
+    size_t text_len;
+    const char *text = lua_tolstring(L, -1, &text_len);
+    descriptor *d = descriptor_compile(L, text, text_len); // options text [descriptor]
+    if (d == NULL)
+    {
+        lua_pop(L, 2);
+        return NULL;
+    }
+    lua_remove(L, -2); // options descriptor
+    if (keep || ctx->option_count < OPTIONS_MAX)
+    {
+        ctx->option_count++;
+        lua_pushvalue(L, arg); // options descriptor expected
+        lua_pushvalue(L, -2);  // options descriptor expected descriptor
+        lua_rawset(L, -4);     // options descriptor
+    }
+    lua_remove(L, -2); // descriptor
+    return d;
+}
+
+/**
+ * Checks whether an argument of the calling function is a string and its value is
+ * any of the values specified in a given descriptor.
+ *
+ * Multiple values can be accepted if concatenated with a bar `|`:
+ *
+ *    check_option(1, 'one|two') -- accepts both `one` and `two`.
+ *
+ * A `nil` value can be accepted by prefixing the value descriptor with a
+ * question mark:
+ *
+ *    check_option(1, '?one') -- matches 'one' or nil
+ *
+ * @function check_option
+ * @tparam integer arg the position of the argument to be tested.
+ * @tparam string expected the acceptable values descriptor.
+ * @usage
+ *    local function foo(mode)
+ *      check_option(1, 'read|write')
+ *      ...
+ * @raise If the descriptor is `nil` or empty; or if the argument position is invalid.
+ */
+static int checks_check_option(lua_State *L)
+{
+    if (stats_enter((context *)lua_touserdata(L, CONTEXT_INDEX))) return stats_call(L, STATS_CHECK_OPTION, checks_check_option);
+
+    int check_level = get_check_level(L, CONTEXT_INDEX);
+    if (check_level == CHECKS_OFF) return 0;
+
+    int arg = (int)luaL_checkinteger(L, 1);
+    size_t expected_len;
+    luaL_checklstring(L, 2, &expected_len);
+    if (expected_len == 0)
+    {
+        return luaL_argerror(L, 2, "empty descriptor");
+    }
+    int level = (int)luaL_optinteger(L, 3, 1);
+
+    context *ctx = (context *)lua_touserdata(L, CONTEXT_INDEX);
+    const descriptor *d = options_push(L, ctx, 2, false); // descriptor
+    if (d == NULL)
+    {
+        return luaL_argerror(L, 2, "invalid descriptor");
+    }
+
+    if (SAMPLING_ENABLED(ctx) && !d->forced && sample_skip(L, CONTEXT_INDEX, 2, arg)) return 0;
+
+    lua_Debug ar;
+    lua_getstack(L, 1, &ar);
+    if (!lua_getlocal(L, &ar, arg))
+    {
+        return luaL_argerror(L, 1, "invalid argument index");
+    }
+
+    // descriptor val
+    type_check_one(L, check_level, level, arg, d, -1);
+    return 0;
+}
+
+// A checker registered as pure, whose results are cached for the tables and userdata it checks;
+// its uservalue is the check function.
+typedef struct
+{
+    lua_Integer id;     // the key of its results in the caches of the values
+    lua_Integer hits;   // number of results found in the cache
+    lua_Integer misses; // number of results computed and cached
+} pure_checker;
+
+// A class declared with checks.class: the metatables of the class and of its ancestors, nearest
+// first. Its uservalue holds the name of the class and the same metatables, which keeps them from
+// being collected, and their addresses reused, while they are compared.
+#define CLASS_NAME 1
+#define CLASS_ANCESTORS 2
+
+typedef struct
+{
+    size_t count;
+    const void *ancestors[];
+} class_info;
+
+// returns the class whose metatable is the one at index `mt`, or NULL.
+static const class_info *class_find(lua_State *L, int mt)
+{
+    mt = lua_absindex(L, mt);
+    lua_rawgetp(L, LUA_REGISTRYINDEX, &classes_key); // classes
+    lua_pushvalue(L, mt);                            // classes mt
+    lua_rawget(L, -2);                               // classes class
+    const class_info *c = (const class_info *)lua_touserdata(L, -1);
+    lua_pop(L, 2);
+    return c;
+}
+
+// returns the class of the value at index `idx`, of type `type`, or NULL.
+static const class_info *class_of(lua_State *L, int idx, int type)
+{
+    if (type != LUA_TTABLE && type != LUA_TUSERDATA) return NULL;
+    if (!lua_getmetatable(L, idx)) return NULL; // mt
+    const class_info *c = class_find(L, -1);
+    lua_pop(L, 1);
+    return c;
+}
+
+// returns whether the class `c` is the class whose metatable is `mt`, or one of its subclasses.
+static bool class_is(const class_info *c, const void *mt)
+{
+    for (size_t i = 0; i < c->count; i++)
+    {
+        if (c->ancestors[i] == mt) return true;
+    }
+    return false;
+}
+
+// the native predicate of a class: whether the value at index `idx` is an instance of the class,
+// whose metatable is `ud`, or of one of its subclasses.
+static bool class_predicate(lua_State *L, int idx, void *ud)
+{
+    const class_info *c = class_of(L, idx, lua_type(L, idx));
+    return c != NULL && class_is(c, ud);
+}
+
+// calls the checker at the top of the stack on the value at index `arg`, popping it, and returns
+// its result. A check performed by the checker can fail with an error that the checker catches,
+// leaving the counters of the failed check running; the ones of the running check are restored.
+static bool checker_call(lua_State *L, context *ctx, const descriptor *d, int arg)
+{
+    stats_frame saved = {ctx->site, ctx->active, ctx->start};
+    bool counting = ctx->stats_mode != STATS_OFF;
+    if (counting)
+    {
+        // the counters are the only mutable part of a compiled descriptor
+        ((descriptor *)d)->checker_calls++;
+        if (ctx->site != NULL) ctx->site->checker_calls++;
+    }
+
+    lua_pushvalue(L, arg); // checker val
+    lua_call(L, 1, 1);     // result
+    bool is_match = lua_toboolean(L, -1);
+    lua_pop(L, 1);
+
+    if (counting)
+    {
+        ctx->site = saved.site;
+        ctx->active = saved.active;
+        ctx->start = saved.start;
+    }
+    return is_match;
+}
+
+// matches the value at index `arg` with the pure checker at the top of the stack, looking up its
+// result in the cache first. The cache holds, for each checked value, a table mapping the checkers
+// to their results, stamped with the generation they were computed in.
+static bool pure_check(lua_State *L, context *ctx, const descriptor *d, int arg, int type)
+{
+    pure_checker *pure = (pure_checker *)lua_touserdata(L, -1);
+    if (type != LUA_TTABLE && type != LUA_TUSERDATA)
+    {
+        lua_getuservalue(L, -1); // pure checker
+        return checker_call(L, ctx, d, arg);
+    }
+
+    lua_Integer generation = ctx->generation;
+    lua_rawgetp(L, LUA_REGISTRYINDEX, &memo_key); // pure memo
+    lua_pushvalue(L, arg);                        // pure memo val
+    if (lua_rawget(L, -2) == LUA_TTABLE)          // pure memo results
+    {
+        if (lua_rawgeti(L, -1, pure->id) == LUA_TNUMBER) // pure memo results stamp
+        {
+            lua_Integer stamp = lua_tointeger(L, -1);
+            if (stamp >> 1 == generation)
+            {
+                pure->hits++;
+                lua_pop(L, 3); // pure
+                return stamp & 1;
+            }
+        }
+        lua_pop(L, 1); // pure memo results
+    }
+    else
+    {
+        lua_pop(L, 1);            // pure memo
+        lua_createtable(L, 1, 0); // pure memo results
+        lua_pushvalue(L, arg);    // pure memo results val
+        lua_pushvalue(L, -2);     // pure memo results val results
+        lua_rawset(L, -4);        // pure memo results
+    }
+
+    pure->misses++;
+    lua_getuservalue(L, -3); // pure memo results checker
+    bool is_match = checker_call(L, ctx, d, arg); // pure memo results
+
+    // stamped with the generation read before the call, so that an invalidation performed by the
+    // checker itself leaves the result stale
+    lua_pushinteger(L, generation * 2 + is_match); // pure memo results stamp
+    lua_rawseti(L, -2, pure->id);                  // pure memo results
+    lua_pop(L, 2);                                 // pure
+    return is_match;
+}
+
+static bool type_match_named(lua_State *L, const descriptor *d, int arg, int type)
+{
+    context *ctx = get_state_context(L);
+    if (ctx->stats_mode != STATS_OFF)
+    {
+        // the counters are the only mutable part of a compiled descriptor
+        ((descriptor *)d)->slow_hits++;
+        if (ctx->site != NULL) ctx->site->slow_hits++;
+    }
+
+    lua_rawgetp(L, LUA_REGISTRYINDEX, &natives_key); // natives
+    native_checkers *natives = (native_checkers *)lua_touserdata(L, -1);
+    lua_pop(L, 1);
+
+    // the names of classes are matched by metatable only, before any type name is read
+    bool has_class = false;
+    const class_info *c = NULL;
+    for (int i = 0; i < d->name_count; i++)
+    {
+        const type_name *name = &d->names[i];
+        const native_checker *native = natives_find(natives, name->name, name->len, name->hash);
+        if (native->predicate != class_predicate) continue;
+        if (!has_class) c = class_of(L, arg, type);
+        has_class = true;
+        if (c != NULL && class_is(c, native->ud)) return true;
+    }
+
+    size_t got_len;
+    const char *got = get_specific_type(L, arg, type, &got_len);
+
+    if ((d->mask & DESC_FILE) && type == LUA_TUSERDATA)
+    {
+        if (str_leq(LUA_FILEHANDLE, str_len(LUA_FILEHANDLE), got, got_len)) return true;
+    }
+
+    for (int i = 0; i < d->name_count; i++)
+    {
+        const type_name *name = &d->names[i];
+        if (!str_leq(got, got_len, name->name, name->len)) continue;
+        if (!has_class) return true;
+        if (natives_find(natives, name->name, name->len, name->hash)->predicate != class_predicate) return true;
+    }
+
+    if (d->name_count == 0) return false;
+
+    for (int i = 0; i < d->name_count; i++)
+    {
+        const type_name *name = &d->names[i];
+        const native_checker *native = natives_find(natives, name->name, name->len, name->hash);
+        if (native->predicate == NULL || native->predicate == class_predicate) continue;
+        if (native->predicate(L, arg, native->ud)) return true;
+    }
+
+    bool is_match = false;
+    lua_rawgetp(L, LUA_REGISTRYINDEX, &checkers_key); // checkers
+    for (int i = 0; i < d->name_count && !is_match; i++)
+    {
+        const type_name *name = &d->names[i];
+        // looked up again, as the checkers called so far may have grown the natives
+        if (has_class && natives_get(L, name->name, name->len) == class_predicate) continue;
+        lua_pushlstring(L, name->name, name->len);             // checkers name
+        int kind = lua_rawget(L, -2);                          // checkers checker
+        if (kind == LUA_TFUNCTION)                             //
+        {                                                      //
+            is_match = checker_call(L, ctx, d, arg);           // checkers
+            continue;                                          //
+        }                                                      //
+        if (kind == LUA_TUSERDATA)                             //
+        {                                                      //
+            is_match = pure_check(L, ctx, d, arg, type);       //
+        }                                                      //
+        lua_pop(L, 1);                                         // checkers
+    }
+    lua_pop(L, 1);
+    return is_match;
+}
+
+// the outcomes of testing a value against a bound.
+enum
+{
+    BOUND_OK,
+    BOUND_BELOW,
+    BOUND_ABOVE,
+    BOUND_NAN,
+};
+
+// returns the bound of a descriptor applying to the value at index `arg`, of type `type`, or NULL;
+// the bound of the subtype of a number is preferred to the one of `number`.
+static const type_bound *bound_find(lua_State *L, const descriptor *d, int arg, int type)
+{
+    unsigned subtype = 0;
+    if (type == LUA_TNUMBER) subtype = lua_isinteger(L, arg) ? DESC_INTEGER : DESC_FLOAT;
+
+    const type_bound *found = NULL;
+    for (int i = 0; i < d->bound_count; i++)
+    {
+        const type_bound *b = &d->bounds[i];
+        if (b->bit == subtype) return b;
+        if (b->bit == TYPE_BIT(type)) found = b;
+    }
+    return found;
+}
+
+// tests the value at index `arg`, of type `type`, against a bound applying to it; `*len` is set
+// to the length of strings and tables.
+static int bound_test(lua_State *L, const type_bound *b, int arg, int type, lua_Integer *len)
+{
+    if (type != LUA_TNUMBER)
+    {
+        lua_Integer n = (lua_Integer)lua_rawlen(L, arg);
+        *len = n;
+        if (b->has_min && n < b->min) return BOUND_BELOW;
+        if (b->has_max && n > b->max) return BOUND_ABOVE;
+        return BOUND_OK;
+    }
+
+    if (b->bit == DESC_INTEGER)
+    {
+        lua_Integer n = lua_tointeger(L, arg);
+        if (b->has_min && n < b->min) return BOUND_BELOW;
+        if (b->has_max && n > b->max) return BOUND_ABOVE;
+        return BOUND_OK;
+    }
+
+    lua_Number n = lua_tonumber(L, arg);
+    if (n != n) return BOUND_NAN;
+    if (b->has_min && n < b->fmin) return BOUND_BELOW;
+    if (b->has_max && n > b->fmax) return BOUND_ABOVE;
+    return BOUND_OK;
+}
+
+// whether the value at index `arg`, of type `type`, matches a bounded alternative of a descriptor.
+static bool bounds_test(lua_State *L, int check_level, const descriptor *d, int arg, int type)
+{
+    unsigned subtype = 0;
+    if (type == LUA_TNUMBER) subtype = lua_isinteger(L, arg) ? DESC_INTEGER : DESC_FLOAT;
+
+    lua_Integer len;
+    for (int i = 0; i < d->bound_count; i++)
+    {
+        const type_bound *b = &d->bounds[i];
+        if (b->bit != TYPE_BIT(type) && b->bit != subtype) continue;
+        if (check_level == CHECKS_PRIMITIVE || bound_test(L, b, arg, type, &len) == BOUND_OK) return true;
+    }
+    return false;
+}
+
+// pushes the message explaining why the value at index `idx`, of type `type`, does not match the
+// bound `b` of a descriptor.
+static void push_bound_error(lua_State *L, const descriptor *d, const type_bound *bound, int idx, int type)
+{
+    idx = lua_absindex(L, idx);
+    lua_Integer len = 0;
+    int outcome = bound_test(L, bound, idx, type, &len);
+
+    luaL_Buffer b;
+    luaL_buffinit(L, &b);
+    append_descriptor(&b, d->body, d->body_len, false);
+    luaL_addstring(&b, " expected, got ");
+    if (type == LUA_TNUMBER)
+    {
+        lua_pushvalue(L, idx); // val
+        luaL_addvalue(&b);
+    }
+    else
+    {
+        lua_pushfstring(L, "a %s of length " LUA_INTEGER_FSPEC, lua_typename(L, type), LUA_INTEGER_FARG(len));
+        luaL_addvalue(&b);
+    }
+
+    bool is_float = bound->bit == TYPE_BIT(LUA_TNUMBER) || bound->bit == DESC_FLOAT;
+    if (outcome == BOUND_NAN)
+    {
+        luaL_addstring(&b, " (not a number)");
+    }
+    else if (is_float)
+    {
+        const char *relation = outcome == BOUND_BELOW ? "less" : "greater";
+        lua_pushfstring(L, " (%s than %f)", relation, outcome == BOUND_BELOW ? bound->fmin : bound->fmax);
+        luaL_addvalue(&b);
+    }
+    else
+    {
+        const char *relation = type == LUA_TNUMBER ? (outcome == BOUND_BELOW ? "less" : "greater")
+                                                   : (outcome == BOUND_BELOW ? "shorter" : "longer");
+        lua_Integer limit = outcome == BOUND_BELOW ? bound->min : bound->max;
+        lua_pushfstring(L, " (%s than " LUA_INTEGER_FSPEC ")", relation, LUA_INTEGER_FARG(limit));
+        luaL_addvalue(&b);
+    }
+    luaL_pushresult(&b);
+}
+
+static bool type_match(lua_State *L, int check_level, const descriptor *d, int arg, int type)
+{
+    unsigned mask = d->mask;
+    if (mask & TYPE_BIT(type)) return true;
+    if (type == LUA_TNUMBER && (mask & (DESC_INTEGER | DESC_FLOAT)))
+    {
+        if (mask & (lua_isinteger(L, arg) ? DESC_INTEGER : DESC_FLOAT)) return true;
+    }
+    if (d->bound_count > 0 && bounds_test(L, check_level, d, arg, type)) return true;
+    if (d->name_count == 0 && !(mask & DESC_FILE)) return false;
+    if (check_level == CHECKS_PRIMITIVE) return type != LUA_TNIL;
+    return type_match_named(L, d, lua_absindex(L, arg), type);
+}
+
+static bool descriptor_test(lua_State *L, int check_level, const descriptor *d, int idx);
+
+// whether the elements of the table at index `idx` match the `{...}` alternative of a descriptor.
+static bool array_test(lua_State *L, int check_level, const descriptor *d, int idx)
+{
+    const descriptor *element = (const descriptor *)d->element;
+    unsigned mask = element->mask;
+
+    lua_Integer n = (lua_Integer)lua_rawlen(L, idx);
+    if (d->limit > 0 && n > d->limit) n = d->limit;
+    for (lua_Integer i = 1; i <= n; i++)
+    {
+        int type = lua_rawgeti(L, idx, i); // value
+        if (!(mask & TYPE_BIT(type)))
+        {
+            if (type != LUA_TNUMBER || !(mask & (lua_isinteger(L, -1) ? DESC_INTEGER : DESC_FLOAT)))
+            {
+                if (!descriptor_test(L, check_level, element, -1))
+                {
+                    lua_pop(L, 1);
+                    return false;
+                }
+            }
+        }
+        lua_pop(L, 1);
+    }
+    return true;
+}
+
+// whether the value at index `idx` matches a compiled descriptor.
+static bool descriptor_test(lua_State *L, int check_level, const descriptor *d, int idx)
+{
+    int type = lua_type(L, idx);
+    if (type == LUA_TNONE) return (d->mask & TYPE_BIT(LUA_TNIL)) != 0;
+
+    if (d->is_option)
+    {
+        if (type == LUA_TNIL && (d->mask & TYPE_BIT(LUA_TNIL))) return true;
+        if (type != LUA_TSTRING) return false;
+        if (check_level == CHECKS_PRIMITIVE) return true;
+
+        size_t got_len;
+        const char *got = lua_tolstring(L, idx, &got_len);
+        return options_find(d, got, got_len);
+    }
+
+    if (type_match(L, check_level, d, idx, type)) return true;
+    if (type == LUA_TTABLE && (d->mask & DESC_ARRAY))
+    {
+        return check_level == CHECKS_PRIMITIVE || array_test(L, check_level, d, lua_absindex(L, idx));
+    }
+    return false;
+}
+
+// pushes the message explaining why the value at index `idx` does not match a compiled descriptor.
+static void push_match_error(lua_State *L, int check_level, const descriptor *d, int idx)
+{
+    int type = lua_type(L, idx);
+    if (type == LUA_TNONE)
+    {
+        push_type_error(L, LUA_TNONE, d->text, d->text_len);
+        return;
+    }
+
+    if (d->is_option)
+    {
+        if (type != LUA_TSTRING)
+        {
+            push_type_error(L, type, "string", str_len("string"));
+            return;
+        }
+        size_t got_len;
+        const char *got = lua_tolstring(L, idx, &got_len);
+        push_option_error(L, got, got_len, d->body + 1, d->body_len - 1);
+        return;
+    }
+
+    if (type == LUA_TTABLE && (d->mask & DESC_ARRAY))
+    {
+        idx = lua_absindex(L, idx);
+        const descriptor *element = (const descriptor *)d->element;
+        lua_Integer n = (lua_Integer)lua_rawlen(L, idx);
+        if (d->limit > 0 && n > d->limit) n = d->limit;
+        for (lua_Integer i = 1; i <= n; i++)
+        {
+            lua_rawgeti(L, idx, i); // value
+            if (!descriptor_test(L, check_level, element, -1))
+            {
+                push_match_error(L, check_level, element, -1);                   // value message
+                lua_pushfstring(L, "element [" LUA_INTEGER_FSPEC "]: %s", LUA_INTEGER_FARG(i), lua_tostring(L, -1)); // value message message
+                lua_replace(L, -3);                                              // message message
+                lua_pop(L, 1);                                                   // message
+                return;
+            }
+            lua_pop(L, 1);
+        }
+    }
+
+    if (type == LUA_TTABLE && d->name_count == 1 && push_schema_error(L, d, idx)) return;
+
+    const type_bound *bound = d->bound_count > 0 ? bound_find(L, d, idx, type) : NULL;
+    if (bound != NULL)
+    {
+        push_bound_error(L, d, bound, idx, type);
+        return;
+    }
+    push_type_error(L, type, d->body, d->body_len);
+}
+
+// matches the value at index `idx` against a compiled descriptor; on mismatch pushes the error
+// message and returns false.
+static bool descriptor_match(lua_State *L, int check_level, const descriptor *d, int idx)
+{
+    if (descriptor_test(L, check_level, d, idx)) return true;
+    push_match_error(L, check_level, d, idx);
+    return false;
+}
+
+#define ERROR_TYPE "ldk.checks.error"
+
+// An argument error raised in object mode; the message is formatted only when the error is
+// converted to a string. The uservalue holds the value of the argument, the name of the blamed
+// function, as pushed by errorL_getsite until it is resolved, and the descriptor, which may not be
+// cached.
+#define ERROR_VALUE 1
+#define ERROR_NAME 2
+#define ERROR_DESCRIPTOR 3
+
+typedef struct
+{
+    errorL_site site;
+    const descriptor *d; // anchored in the uservalue
+    int check_level;
+    int type; // the type of the argument, or LUA_TNONE if missing
+} check_error;
+
+// raises the error for the argument `arg` not matching a descriptor; `idx` is the index of the
+// value of the argument, or 0 if the argument is missing.
+static void type_error(lua_State *L, int check_level, int level, int arg, const descriptor *d, int idx)
+{
+    if (idx != 0) idx = lua_absindex(L, idx);
+    context *ctx = get_state_context(L);
+    stats_failure(ctx);
+    if (ctx->error_mode == ERRORS_OBJECT)
+    {
+        check_error *err = (check_error *)lua_newuserdata(L, sizeof(check_error)); // err
+        err->d = d;
+        err->check_level = check_level;
+        err->type = idx == 0 ? LUA_TNONE : lua_type(L, idx);
+        lua_createtable(L, 3, 0); // err uv
+        if (idx != 0)
+        {
+            lua_pushvalue(L, idx);           // err uv val
+            lua_rawseti(L, -2, ERROR_VALUE); // err uv
+        }
+        lua_rawgetp(L, LUA_REGISTRYINDEX, &descriptor_refs_key); // err uv refs
+        lua_rawgetp(L, -1, d);                                   // err uv refs descriptor
+        lua_rawseti(L, -3, ERROR_DESCRIPTOR);                    // err uv refs
+        lua_pop(L, 1);                                           // err uv
+        errorL_getsite(L, level, arg, &err->site); // err uv name
+        lua_rawseti(L, -2, ERROR_NAME);            // err uv
+        lua_setuservalue(L, -2);                   // err
+        luaL_setmetatable(L, ERROR_TYPE); // err
+        lua_error(L);
+    }
+
+    if (idx == 0)
+    {
+        push_type_error(L, LUA_TNONE, d->text, d->text_len);
+    }
+    else
+    {
+        push_match_error(L, check_level, d, idx);
+    }
+    errorL_argerror(L, level, arg, lua_tostring(L, -1));
+}
+
+// checks the value at index `idx` against a compiled descriptor, raising an error on mismatch.
+static void type_check_one(lua_State *L, int check_level, int level, int arg, const descriptor *d, int idx)
+{
+    if (!descriptor_test(L, check_level, d, idx))
+    {
+        type_error(L, check_level, level, arg, d, idx);
+    }
+}
+
+// pushes the message of an error object, without the location and the function name.
+static void error_push_message(lua_State *L, const check_error *err, int idx)
+{
+    if (err->type == LUA_TNONE)
+    {
+        push_type_error(L, LUA_TNONE, err->d->text, err->d->text_len);
+        return;
+    }
+    lua_getuservalue(L, idx);        // uv
+    lua_rawgeti(L, -1, ERROR_VALUE); // uv val
+    lua_remove(L, -2);               // val
+    if (descriptor_test(L, err->check_level, err->d, -1))
+    {
+        // the value has changed since the check failed
+        push_type_error(L, err->type, err->d->body, err->d->body_len); // val message
+    }
+    else
+    {
+        push_match_error(L, err->check_level, err->d, -1); // val message
+    }
+    lua_remove(L, -2); // message
+}
+
+// pushes the name of the function blamed by the error object at index `idx`, resolving it on first
+// use.
+static void error_push_name(lua_State *L, int idx)
+{
+    lua_getuservalue(L, idx);       // uv
+    lua_rawgeti(L, -1, ERROR_NAME); // uv name
+    if (lua_type(L, -1) != LUA_TSTRING)
+    {
+        errorL_pushname(L, -1);         // uv f name
+        lua_replace(L, -2);             // uv name
+        lua_pushvalue(L, -1);           // uv name name
+        lua_rawseti(L, -3, ERROR_NAME); // uv name
+    }
+    lua_remove(L, -2); // name
+}
+
+static int error_tostring(lua_State *L)
+{
+    const check_error *err = (const check_error *)luaL_checkudata(L, 1, ERROR_TYPE);
+    error_push_name(L, 1);                                   // name
+    error_push_message(L, err, 1);                           // name message
+    errorL_pushsite(L, &err->site, -2, lua_tostring(L, -1)); // name message string
+    return 1;
+}
+
+static int error_index(lua_State *L)
+{
+    const check_error *err = (const check_error *)luaL_checkudata(L, 1, ERROR_TYPE);
+    const char *field = luaL_checkstring(L, 2);
+    if (strcmp(field, "arg") == 0)
+    {
+        lua_pushinteger(L, err->site.arg);
+    }
+    else if (strcmp(field, "expected") == 0)
+    {
+        lua_pushlstring(L, err->d->text, err->d->text_len);
+    }
+    else if (strcmp(field, "got") == 0)
+    {
+        lua_pushstring(L, err->type == LUA_TNONE ? "no value" : lua_typename(L, err->type));
+    }
+    else if (strcmp(field, "value") == 0)
+    {
+        lua_getuservalue(L, 1);          // uv
+        lua_rawgeti(L, -1, ERROR_VALUE); // uv val
+    }
+    else if (strcmp(field, "message") == 0)
+    {
+        error_push_message(L, err, 1);
+    }
+    else if (strcmp(field, "name") == 0 && err->site.has_name)
+    {
+        error_push_name(L, 1);
+    }
+    else if (strcmp(field, "source") == 0 && err->site.line > 0)
+    {
+        lua_pushstring(L, err->site.source);
+    }
+    else if (strcmp(field, "line") == 0 && err->site.line > 0)
+    {
+        lua_pushinteger(L, err->site.line);
+    }
+    else
+    {
+        lua_pushnil(L);
+    }
+    return 1;
+}
+
+static const struct luaL_Reg error_methods[] = {
+    {"__index", error_index},
+    {"__tostring", error_tostring},
+    {NULL, NULL},
+};
+
+/***
+ * Checks whether the specified argument of the calling function is of any of the types specified in
+ * the given descriptor.
+ *
+ * The type of the argument at position `arg` must match one of the types in `expected.
+ *
+ * Each type can be the name of a primitive Lua type:
+ *
+ * * `nil`
+ * * `boolean`
+ * * `userdata`
+ * * `number`
+ * * `string`
+ * * `table`
+ * * `function`
+ * * `thread`
+ *
+ * one of the following options:
+ *
+ * * `any` (accepts any non-nil argument type)
+ * * `file` (accepts a file object)
+ * * `integer` (accepts an integer number)
+ * * `float` (accepts a floating point number)
+ * * `callable` (accepts a function or a value with a `__call` metamethod)
+ * * `nonempty` (accepts a non-empty string or table)
+ * * `positive` (accepts a number greater than zero)
+ * * `array` (accepts a table whose keys are exactly the integers from 1 to its length)
+ * * `ascii` (accepts a string made only of ASCII characters)
+ * * `utf8` (accepts a string of valid UTF-8)
+ * * `printable` (accepts a string of valid UTF-8 without control characters other than tab, line
+ * feed and carriage return)
+ * * an arbitrary string, matched against the content of the `__type` or `__name` field of the
+ * argument's metatable if the argument is table or a userdata, respectively.
+ *
+ * Multiple values can be accepted if concatenated with a bar `|`:
+ *
+ *    check_type(1, 'integer|table') -- matches an integer or a table
+ *
+ * A `nil` value can be matched by prefixing the type descriptor with `?`:
+ *
+ *     checktype(1, '?table') -- matches a table or nil
+ *
+ * A table whose elements all match a descriptor can be matched by enclosing the descriptor in
+ * braces; a `:n` suffix limits the check to the first `n` elements:
+ *
+ *     checktype(1, '{integer}')        -- matches a table of integers
+ *     checktype(1, '?{string|Point}')  -- matches nil or a table of strings and Points
+ *     checktype(1, '{number:100}')     -- checks only the first 100 elements
+ *
+ * The value of a `number`, `integer` or `float`, and the length of a `string` or `table`, can be
+ * bounded by a `[min,max]` suffix; either bound can be omitted, and the error names the violated
+ * bound:
+ *
+ *     checktype(1, 'integer[0,65535]') -- matches an integer from 0 to 65535
+ *     checktype(1, 'string[1,255]')    -- matches a string of 1 to 255 bytes
+ *     checktype(1, 'table[1,]|nil')    -- matches nil or a table with at least one element
+ *
+ * Finally, if a descriptor is prefixed with `:`, the function will behave like @{check_option}.
+ *
+ *     checktype(1, ':one|two') -- matches 'one' or 'two'
+ *
+ * Descriptors are compiled the first time they are seen and the compiled form is cached in the Lua
+ * state, so checking again against the same descriptor does not parse it anew. Likewise, the
+ * `__type` or `__name` field of a metatable is read the first time the metatable is seen; after
+ * changing the field of a metatable already seen, pass the metatable to @{invalidate}.
+ *
+ * @remark Prefixes are processed in order: first `:` then `?`.
+ * @function check_type
+ * @tparam integer arg position of the argument to be tested.
+ * @tparam string expected the descriptor of the expected type.
+ * @tparam[opt=1] integer level the level in the call stack at which to report the error.
+ * @usage
+ *    local function foo(t, filter)
+ *      check_type(1, 'table')
+ *      check_type(2, '?function')
+ *      ...
+ */
+static int checks_check_type(lua_State *L)
+{
+    if (stats_enter((context *)lua_touserdata(L, CONTEXT_INDEX))) return stats_call(L, STATS_CHECK_TYPE, checks_check_type);
+
+    int check_level = get_check_level(L, CONTEXT_INDEX);
+    if (check_level == CHECKS_OFF) return 0;
+
+    int arg = (int)luaL_checkinteger(L, 1);
+
+    size_t expected_len;
+    luaL_checklstring(L, 2, &expected_len);
+    if (expected_len == 0)
+    {
+        return luaL_argerror(L, 2, "empty descriptor");
+    }
+    int level = (int)luaL_optinteger(L, 3, 1);
+
+    push_descriptors(L);                                     // descriptors
+    const descriptor *d = descriptor_push(L, -1, 2, false); // descriptors descriptor
+    if (d == NULL || d->repeat)
+    {
+        return luaL_argerror(L, 2, "invalid descriptor");
+    }
+
+    const context *ctx = (const context *)lua_touserdata(L, CONTEXT_INDEX);
+    if (SAMPLING_ENABLED(ctx) && !d->forced && sample_skip(L, CONTEXT_INDEX, 2, arg)) return 0;
+
+    lua_Debug ar;
+    lua_getstack(L, 1, &ar);
+    if (!lua_getlocal(L, &ar, arg))
+    {
+        return luaL_argerror(L, 1, "invalid argument index");
+    }
+
+    // descriptors descriptor val
+    type_check_one(L, check_level, level, arg, d, -1);
+    return 0;
+}
+
+// returns whether any of the `n` descriptors from index 1 is never sampled out.
+static bool descriptors_forced(lua_State *L, const context *ctx, int cache, int n)
+{
+    if (ctx->forced_count == 0) return false;
+    for (int arg = 1; arg <= n; arg++)
+    {
+        if (lua_type(L, arg) != LUA_TSTRING) continue;
+        const descriptor *d = descriptor_push(L, cache, arg, false); // [descriptor]
+        if (d == NULL) continue;
+        bool forced = d->forced;
+        lua_pop(L, 1);
+        if (forced) return true;
+    }
+    return false;
+}
+
+// checks the argument at position `arg` of the function at `ar` against a descriptor.
+static void check_local(lua_State *L, int check_level, int level, lua_Debug *ar, int arg, const descriptor *d)
+{
+    if (!lua_getlocal(L, ar, arg))
+    {
+        type_error(L, check_level, level, arg, d, 0);
+    }
+
+    // val
+    type_check_one(L, check_level, level, arg, d, -1);
+    lua_pop(L, 1);
+}
+
+// checks the arguments of the function at `ar`, from position `arg` onwards, against a repeated descriptor.
+static void check_locals(lua_State *L, int check_level, int level, lua_Debug *ar, int arg, const descriptor *d)
+{
+    int arg_count = arg;
+    while (lua_getlocal(L, ar, arg)) // val
+    {
+        type_check_one(L, check_level, level, arg++, d, -1);
+        lua_pop(L, 1);
+    }
+
+    int vararg = -1;
+    while (lua_getlocal(L, ar, vararg--)) // val
+    {
+        type_check_one(L, check_level, level, arg++, d, -1);
+        lua_pop(L, 1);
+    }
+
+    if (arg > arg_count || d->repeat == '*') return;
+    type_error(L, check_level, level, arg, d, 0);
+}
+
+/***
+ * Checks whether the arguments of the calling function are of the specified types.
+ *
+ * The last descriptor can be prefixed with:
+ *
+ * -  a `*` to make it match zero more more arguments.
+ * -  a `+` to make it match one more more arguments.
+ *
+ * @function check_types
+ * @tparam string ... the descriptors of the expected types (see @{check_type}).
+ * @tparam[opt=1] integer level the level in the call stack at which to report the error.
+ * @usage
+ *    local function foo(t, filter)
+ *      check_types('table', '?function')
+ *      ...
+ */
+static int checks_check_types(lua_State *L)
+{
+    if (stats_enter((context *)lua_touserdata(L, CONTEXT_INDEX))) return stats_call(L, STATS_CHECK_TYPES, checks_check_types);
+
+    int check_level = get_check_level(L, CONTEXT_INDEX);
+    if (check_level == CHECKS_OFF) return 0;
+
+    int n = lua_gettop(L);
+
+    int level = 1;
+    if (lua_isinteger(L, -1))
+    {
+        level = lua_tointeger(L, -1);
+        n--;
+    }
+
+    push_descriptors(L); // descriptors
+    int cache = lua_gettop(L);
+
+    const context *ctx = (const context *)lua_touserdata(L, CONTEXT_INDEX);
+    if (SAMPLING_ENABLED(ctx) && !descriptors_forced(L, ctx, cache, n) && sample_skip(L, CONTEXT_INDEX, 1, 0)) return 0;
+
+    lua_Debug ar;
+    lua_getstack(L, 1, &ar);
+
+    for (int arg = 1; arg <= n; arg++)
+    {
+        size_t expected_len;
+        luaL_checklstring(L, arg, &expected_len);
+        if (expected_len == 0)
+        {
+            return luaL_argerror(L, arg, "empty descriptor");
+        }
+
+        const descriptor *d = descriptor_push(L, cache, arg, false); // descriptor
+        if (d == NULL)
+        {
+            return luaL_argerror(L, arg, "invalid descriptor");
+        }
+        if (d->repeat)
+        {
+            check_locals(L, check_level, level, &ar, arg, d);
+            break;
+        }
+        check_local(L, check_level, level, &ar, arg, d);
+        lua_pop(L, 1);
+    }
+    return 0;
+}
+
+// pushes the compiled form of the descriptor at index `arg` for the predicates, raising an error if
+// it is not a valid descriptor; `cache` is the index of the descriptor cache.
+static const descriptor *predicate_descriptor(lua_State *L, int cache, int arg)
+{
+    luaL_checkstring(L, arg);
+    const descriptor *d = descriptor_push(L, cache, arg, false);
+    if (d == NULL || d->repeat)
+    {
+        luaL_argerror(L, arg, "invalid descriptor");
+    }
+    return d;
+}
+
+/***
+ * Returns whether a value matches a descriptor.
+ *
+ * The descriptor has the same syntax as in @{check_type}, and the value is matched as
+ * @{check_type} would match an argument, but no error is raised; the check level does not apply.
+ *
+ * @function is
+ * @param value the value to test.
+ * @tparam string expected the descriptor of the expected type.
+ * @treturn bool `true` if the value matches the descriptor; `false` otherwise.
+ * @usage
+ *    if is(x, '?integer|table') then ... end
+ */
+static int checks_is(lua_State *L)
+{
+    push_descriptors(L);                                  // descriptors
+    const descriptor *d = predicate_descriptor(L, -1, 2); // descriptors descriptor
+    lua_pushboolean(L, descriptor_test(L, CHECKS_FULL, d, 1));
+    return 1;
+}
+
+/***
+ * Returns the position of the first descriptor a value matches.
+ *
+ * The descriptors have the same syntax as in @{check_type}; no error is raised if the value
+ * matches none of them, and the check level does not apply.
+ *
+ * @function which
+ * @param value the value to test.
+ * @tparam string ... the descriptors to test the value against.
+ * @treturn ?integer the position of the first matching descriptor among the given ones, or
+ * `nil` if the value matches none.
+ * @usage
+ *    local kind = which(x, 'string', '{string}', 'table')
+ */
+static int checks_which(lua_State *L)
+{
+    int top = lua_gettop(L);
+    push_descriptors(L); // descriptors
+    int cache = lua_gettop(L);
+    for (int i = 2; i <= top; i++)
+    {
+        const descriptor *d = predicate_descriptor(L, cache, i); // descriptors descriptor
+        if (descriptor_test(L, CHECKS_FULL, d, 1))
+        {
+            lua_pushinteger(L, i - 1);
+            return 1;
+        }
+        lua_pop(L, 1); // descriptors
+    }
+    lua_pushnil(L);
+    return 1;
+}
+
+#define SIGNATURE_TYPE "ldk.checks.signature"
+
+struct ldk_checks_signature
+{
+    int count;                       // number of descriptors
+    const descriptor *descriptors[]; // the compiled descriptors, in argument order
+};
+
+typedef struct ldk_checks_signature signature;
+
+// creates a signature from the `n` descriptor strings starting at index `first`, and pushes it;
+// returns 0, or the position of the first invalid descriptor, in which case nothing is pushed.
+static int signature_new(lua_State *L, int first, int n)
+{
+    push_descriptors(L); // descriptors
+    int cache = lua_gettop(L);
+
+    signature *sig = (signature *)lua_newuserdata(L, sizeof(signature) + (size_t)n * sizeof(const descriptor *));
+    sig->count = 0;
+    luaL_setmetatable(L, SIGNATURE_TYPE);
+    lua_createtable(L, n, 0); // descriptors sig anchors
+
+    for (int i = 1; i <= n; i++)
+    {
+        int arg = first + i - 1;
+        const descriptor *d = descriptor_push(L, cache, arg, false); // descriptors sig anchors [descriptor]
+        if (d == NULL || (d->repeat && i < n))
+        {
+            lua_settop(L, cache - 1);
+            return i;
+        }
+        lua_rawseti(L, -2, i); // descriptors sig anchors
+        sig->descriptors[sig->count++] = d;
+    }
+    lua_setuservalue(L, -2); // descriptors sig
+    lua_remove(L, -2);       // sig
+    return 0;
+}
+
+/***
+ * Creates a signature, that is a precompiled list of type descriptors that can be used to check the
+ * arguments of a function.
+ *
+ * The descriptors are validated when the signature is created; checking the arguments with the
+ * signature performs no descriptor processing. The last descriptor can be prefixed with `*` or
+ * `+` (see @{check_types}).
+ *
+ * A signature can be called, or its `check` method invoked, with an optional `level` argument to
+ * check the arguments of the calling function.
+ *
+ * @function signature
+ * @tparam string ... the descriptors of the expected types (see @{check_type}).
+ * @return the signature.
+ * @usage
+ *    local sig = signature('table', '?function')
+ *    local function foo(t, filter)
+ *      sig()
+ *      ...
+ */
+static int checks_signature(lua_State *L)
+{
+    int n = lua_gettop(L);
+    for (int arg = 1; arg <= n; arg++)
+    {
+        size_t expected_len;
+        luaL_checklstring(L, arg, &expected_len);
+        if (expected_len == 0)
+        {
+            return luaL_argerror(L, arg, "empty descriptor");
+        }
+    }
+
+    int arg = signature_new(L, 1, n);
+    if (arg != 0)
+    {
+        return luaL_argerror(L, arg, "invalid descriptor");
+    }
+    return 1;
+}
+
+static int signature_check(lua_State *L)
+{
+    if (stats_enter((context *)lua_touserdata(L, CONTEXT_INDEX))) return stats_call(L, STATS_SIGNATURE, signature_check);
+
+    int check_level = get_check_level(L, CONTEXT_INDEX);
+    if (check_level == CHECKS_OFF) return 0;
+
+    const signature *sig = (const signature *)luaL_checkudata(L, 1, SIGNATURE_TYPE);
+    int level = (int)luaL_optinteger(L, 2, 1);
+
+    lua_Debug ar;
+    lua_getstack(L, 1, &ar);
+
+    for (int i = 0; i < sig->count; i++)
+    {
+        const descriptor *d = sig->descriptors[i];
+        if (d->repeat)
+        {
+            check_locals(L, check_level, level, &ar, i + 1, d);
+            break;
+        }
+        check_local(L, check_level, level, &ar, i + 1, d);
+    }
+    return 0;
+}
+
+// checks the values on the stack, from index 1 to `top`, against a signature.
+static void signature_check_stack(lua_State *L, int check_level, const signature *sig, int level, int top)
+{
+    for (int i = 0; i < sig->count; i++)
+    {
+        const descriptor *d = sig->descriptors[i];
+        int arg = i + 1;
+        if (d->repeat)
+        {
+            for (; arg <= top; arg++)
+            {
+                type_check_one(L, check_level, level, arg, d, arg);
+            }
+            if (top > i || d->repeat == '*') return;
+        }
+        else if (arg <= top)
+        {
+            type_check_one(L, check_level, level, arg, d, arg);
+            continue;
+        }
+        else if (d->mask & TYPE_BIT(LUA_TNIL))
+        {
+            continue;
+        }
+        type_error(L, check_level, level, arg, d, 0);
+    }
+}
+
+static int wrapper_finish(lua_State *L, int status, lua_KContext ctx)
+{
+    (void)status;
+    (void)ctx;
+    return lua_gettop(L);
+}
+
+static int wrapper(lua_State *L)
+{
+    const signature *sig = (const signature *)lua_touserdata(L, lua_upvalueindex(1));
+    context *ctx = (context *)lua_touserdata(L, lua_upvalueindex(3));
+    int n = lua_gettop(L);
+
+    int check_level = ctx->check_level;
+    if (ctx->module_count > 0)
+    {
+        lua_pushvalue(L, lua_upvalueindex(2)); // ... fn
+        check_level = resolve_check_level(L, lua_upvalueindex(3));
+    }
+    if (check_level != CHECKS_OFF && ctx->stats_mode == STATS_OFF)
+    {
+        signature_check_stack(L, check_level, sig, 0, n);
+    }
+    else if (check_level != CHECKS_OFF)
+    {
+        stats_frame saved;
+        stats_begin(L, ctx, STATS_WRAP, &saved);
+        signature_check_stack(L, check_level, sig, 0, n);
+        stats_end(ctx, &saved);
+    }
+
+    lua_pushvalue(L, lua_upvalueindex(2)); // ... fn
+    lua_insert(L, 1);                      // fn ...
+    lua_callk(L, n, LUA_MULTRET, 0, wrapper_finish);
+    return wrapper_finish(L, LUA_OK, 0);
+}
+
+/***
+ * Wraps a function so that its arguments are checked against a signature before it is called.
+ *
+ * The arguments are checked directly on the stack of the returned function, without going through
+ * the debug interface; errors are reported against the name the wrapper is called with.
+ *
+ * @function wrap
+ * @tparam signature signature the signature of the function (see @{signature}).
+ * @tparam function fn the function to wrap.
+ * @treturn function the wrapped function.
+ * @usage
+ *    local foo = wrap(signature('table', '?function'), function(t, filter)
+ *      ...
+ *    end)
+ */
+static int checks_wrap(lua_State *L)
+{
+    luaL_checkudata(L, 1, SIGNATURE_TYPE);
+    luaL_checktype(L, 2, LUA_TFUNCTION);
+    lua_settop(L, 2);
+    lua_pushvalue(L, CONTEXT_INDEX);
+    lua_pushcclosure(L, wrapper, 3);
+    return 1;
+}
+
+static const struct luaL_Reg signature_methods[] = {
+    {"check", signature_check},
+    {NULL, NULL},
+};
+
+#define DISPATCH_MAX 32
+
+// The overloads of a dispatcher; the signature and the function of the i-th overload are anchored
+// in the second upvalue of the dispatching function at positions i and count + i.
+typedef struct
+{
+    int count;
+    uint32_t candidates[LUA_NUMTAGS + 1]; // overloads that can accept the type of the first argument
+    const signature *signatures[DISPATCH_MAX];
+} dispatcher;
+
+// the slot of `candidates` for a type tag, including LUA_TNONE.
+#define DISPATCH_SLOT(type) ((type) + 1)
+
+// whether a descriptor can match a value of the given type.
+static bool descriptor_accepts(const descriptor *d, int type)
+{
+    if (type == LUA_TNONE) return (d->mask & TYPE_BIT(LUA_TNIL)) || d->repeat == '*';
+    if (d->mask & TYPE_BIT(type)) return true;
+    if (d->is_option) return type == LUA_TSTRING;
+    if (type == LUA_TNUMBER && (d->mask & (DESC_INTEGER | DESC_FLOAT))) return true;
+    if (type == LUA_TTABLE && (d->mask & DESC_ARRAY)) return true;
+    for (int i = 0; i < d->bound_count; i++)
+    {
+        unsigned bit = d->bounds[i].bit;
+        if (bit == TYPE_BIT(type) || (type == LUA_TNUMBER && (bit & (DESC_INTEGER | DESC_FLOAT)))) return true;
+    }
+    return type != LUA_TNIL && (d->name_count > 0 || (d->mask & DESC_FILE));
+}
+
+// whether the values on the stack, from index 1 to `top`, match a signature; the values past the
+// signature must be nil.
+static bool signature_test(lua_State *L, const signature *sig, int top)
+{
+    int arg = 1;
+    for (int i = 0; i < sig->count; i++, arg++)
+    {
+        const descriptor *d = sig->descriptors[i];
+        if (d->repeat)
+        {
+            for (; arg <= top; arg++)
+            {
+                if (!descriptor_test(L, CHECKS_FULL, d, arg)) return false;
+            }
+            return top > i || d->repeat == '*';
+        }
+        if (arg <= top)
+        {
+            if (!descriptor_test(L, CHECKS_FULL, d, arg)) return false;
+        }
+        else if (!(d->mask & TYPE_BIT(LUA_TNIL)))
+        {
+            return false;
+        }
+    }
+    for (; arg <= top; arg++)
+    {
+        if (!lua_isnil(L, arg)) return false;
+    }
+    return true;
+}
+
+static void append_signature(luaL_Buffer *b, const signature *sig)
+{
+    luaL_addchar(b, '(');
+    for (int i = 0; i < sig->count; i++)
+    {
+        if (i > 0) luaL_addstring(b, ", ");
+        luaL_addlstring(b, sig->descriptors[i]->text, sig->descriptors[i]->text_len);
+    }
+    luaL_addchar(b, ')');
+}
+
+// raises the error for the values on the stack, from index 1 to `top`, matching no overload.
+static int dispatch_error(lua_State *L, const dispatcher *dp, int top)
+{
+    luaL_Buffer b;
+    luaL_buffinit(L, &b);
+    luaL_addstring(&b, "got (");
+    for (int arg = 1; arg <= top; arg++)
+    {
+        if (arg > 1) luaL_addstring(&b, ", ");
+        luaL_addstring(&b, luaL_typename(L, arg));
+    }
+    luaL_addstring(&b, "), expected ");
+    for (int i = 0; i < dp->count; i++)
+    {
+        if (i > 0) luaL_addstring(&b, i == dp->count - 1 ? " or " : ", ");
+        append_signature(&b, dp->signatures[i]);
+    }
+    luaL_pushresult(&b); // ... message
+
+    errorL_site site;
+    errorL_getsite(L, 0, 1, &site); // ... message name
+    errorL_pushname(L, -1);         // ... message name name
+    return errorL_errorf(L, 0, "bad arguments to '%s' (%s)", lua_tostring(L, -1), lua_tostring(L, -3));
+}
+
+static int dispatch(lua_State *L)
+{
+    const dispatcher *dp = (const dispatcher *)lua_touserdata(L, lua_upvalueindex(1));
+    int top = lua_gettop(L);
+
+    uint32_t candidates = dp->candidates[DISPATCH_SLOT(lua_type(L, 1))];
+    for (int i = 0; candidates != 0; i++, candidates >>= 1)
+    {
+        if (!(candidates & 1) || !signature_test(L, dp->signatures[i], top)) continue;
+
+        lua_rawgeti(L, lua_upvalueindex(2), dp->count + i + 1); // ... fn
+        lua_insert(L, 1);                                       // fn ...
+        lua_callk(L, top, LUA_MULTRET, 0, wrapper_finish);
+        return wrapper_finish(L, LUA_OK, 0);
+    }
+    return dispatch_error(L, dp, top);
+}
+
+/***
+ * Creates a function that calls the first of a list of overloads whose signature matches its
+ * arguments.
+ *
+ * Each overload is a table holding the descriptors of the signature of the overload (see
+ * @{signature}) followed by the function to call; arguments past the signature must be `nil`.
+ * The overloads are tried in order, but only those whose first descriptor can match the type of the
+ * first argument are tested. If no overload matches, an error listing all the signatures is raised.
+ *
+ * The overloads are always selected with full checks, regardless of the check level.
+ *
+ * @function dispatch
+ * @tparam table overloads the overloads, at most 32.
+ * @treturn function the dispatching function.
+ * @usage
+ *    local open = dispatch {
+ *      {'string', '?table', open_path},
+ *      {'table', open_options},
+ *    }
+ */
+static int checks_dispatch(lua_State *L)
+{
+    luaL_checktype(L, 1, LUA_TTABLE);
+    int count = (int)lua_rawlen(L, 1);
+    luaL_argcheck(L, count > 0, 1, "no overloads");
+    luaL_argcheck(L, count <= DISPATCH_MAX, 1, "too many overloads");
+    lua_settop(L, 1);
+
+    dispatcher *dp = (dispatcher *)lua_newuserdata(L, sizeof(dispatcher)); // overloads dp
+    memset(dp, 0, sizeof(dispatcher));
+    lua_createtable(L, 2 * count, 0); // overloads dp anchors
+
+    for (int i = 1; i <= count; i++)
+    {
+        if (lua_rawgeti(L, 1, i) != LUA_TTABLE) // overloads dp anchors overload
+        {
+            return luaL_error(L, "invalid overload %d (a %s)", i, luaL_typename(L, -1));
+        }
+        int n = (int)lua_rawlen(L, -1);
+        if (n == 0 || lua_rawgeti(L, -1, n) != LUA_TFUNCTION) // overloads dp anchors overload fn
+        {
+            return luaL_error(L, "invalid overload %d (function expected)", i);
+        }
+        lua_rawseti(L, -3, count + i); // overloads dp anchors overload
+
+        int first = lua_gettop(L) + 1;
+        for (int j = 1; j < n; j++)
+        {
+            if (lua_rawgeti(L, first - 1, j) != LUA_TSTRING || lua_rawlen(L, -1) == 0)
+            {
+                return luaL_error(L, "invalid descriptor %d in overload %d", j, i);
+            }
+        }
+        int bad = signature_new(L, first, n - 1); // overloads dp anchors overload descriptors... sig
+        if (bad != 0)
+        {
+            return luaL_error(L, "invalid descriptor %d in overload %d", bad, i);
+        }
+
+        const signature *sig = (const signature *)lua_touserdata(L, -1);
+        dp->signatures[i - 1] = sig;
+        for (int type = LUA_TNONE; type < LUA_NUMTAGS; type++)
+        {
+            bool accepts = sig->count == 0 ? type == LUA_TNONE || type == LUA_TNIL
+                                           : descriptor_accepts(sig->descriptors[0], type);
+            if (accepts) dp->candidates[DISPATCH_SLOT(type)] |= UINT32_C(1) << (i - 1);
+        }
+        lua_rawseti(L, 3, i); // overloads dp anchors overload descriptors...
+        lua_settop(L, 3);     // overloads dp anchors
+    }
+    dp->count = count;
+    lua_pushcclosure(L, dispatch, 2);
+    return 1;
+}
+
+#define SCHEMA_TYPE "ldk.checks.schema"
+
+// A field of a schema; the key and the compiled descriptor or nested schema of the i-th field are
+// anchored in the schema uservalue at positions i and count + i.
+typedef struct
+{
+    const descriptor *d; // the descriptor of the field, or NULL if the field is a nested schema
+} schema_field;
+
+typedef struct
+{
+    bool optional; // the schema accepts nil when nested in another schema
+    int count;     // number of fields
+    schema_field fields[];
+} schema;
+
+// creates a schema from the definition at index `def`, and pushes it.
+static void schema_new(lua_State *L, int def, bool optional)
+{
+    def = lua_absindex(L, def);
+
+    int count = 0;
+    for (lua_pushnil(L); lua_next(L, def); lua_pop(L, 1)) count++;
+
+    push_descriptors(L); // descriptors
+    int cache = lua_gettop(L);
+
+    schema *s = (schema *)lua_newuserdata(L, sizeof(schema) + (size_t)count * sizeof(schema_field)); // descriptors s
+    s->optional = optional;
+    s->count = 0;
+    luaL_setmetatable(L, SCHEMA_TYPE);
+    lua_createtable(L, 2 * count, 0); // descriptors s uv
+
+    lua_pushnil(L);          // descriptors s uv nil
+    while (lua_next(L, def)) // descriptors s uv key value
+    {
+        int key_type = lua_type(L, -2);
+        if (key_type != LUA_TSTRING && !lua_isinteger(L, -2))
+        {
+            luaL_error(L, "invalid field name (a %s)", lua_typename(L, key_type));
+        }
+
+        schema_field *f = &s->fields[s->count++];
+        if (lua_type(L, -1) == LUA_TSTRING)
+        {
+            f->d = descriptor_push(L, cache, -1, false); // descriptors s uv key value [descriptor]
+            if (f->d == NULL || f->d->repeat)
+            {
+                lua_pushvalue(L, -3); // descriptors s uv key value [descriptor] key
+                luaL_error(L, "invalid descriptor for field '%s'", lua_tostring(L, -1));
+            }
+            lua_replace(L, -2); // descriptors s uv key descriptor
+        }
+        else if (luaL_testudata(L, -1, SCHEMA_TYPE))
+        {
+            f->d = NULL;
+        }
+        else if (lua_type(L, -1) == LUA_TTABLE)
+        {
+            f->d = NULL;
+            schema_new(L, -1, false); // descriptors s uv key value nested
+            lua_replace(L, -2);       // descriptors s uv key nested
+        }
+        else
+        {
+            lua_pushvalue(L, -2); // descriptors s uv key value key
+            luaL_error(L, "invalid descriptor for field '%s'", lua_tostring(L, -1));
+        }
+        lua_rawseti(L, -3, count + s->count); // descriptors s uv key
+        lua_pushvalue(L, -1);                 // descriptors s uv key key
+        lua_rawseti(L, -3, s->count);         // descriptors s uv key
+    }
+    lua_setuservalue(L, -2); // descriptors s
+    lua_remove(L, -2);       // s
+}
+
+// pushes the path of the field named by the key at index `key`.
+static void push_field_path(lua_State *L, int key)
+{
+    if (lua_type(L, key) == LUA_TSTRING)
+    {
+        lua_pushvalue(L, key);
+    }
+    else
+    {
+        lua_pushfstring(L, "[" LUA_INTEGER_FSPEC "]", LUA_INTEGER_FARG(lua_tointeger(L, key)));
+    }
+}
+
+static void push_table_error(lua_State *L, int type, bool optional)
+{
+    const char *expected = optional ? "?table" : "table";
+    push_type_error(L, type, expected, strlen(expected));
+}
+
+// moves the path and the message at the top of the stack to index `base`, dropping everything
+// above it; returns false.
+static bool schema_mismatch(lua_State *L, int base)
+{
+    lua_copy(L, -2, base);
+    lua_copy(L, -1, base + 1);
+    lua_settop(L, base + 1);
+    return false;
+}
+
+// The states of a (table, schema) pair reached in a validation pass.
+enum
+{
+    PASS_UNKNOWN, // to be checked again
+    PASS_ACTIVE,  // being checked; when reached again through a cycle, it is assumed to match
+    PASS_MATCHED,
+    PASS_FAILED,
+};
+
+typedef struct
+{
+    const void *table;
+    const schema *s;
+    int check_level;
+    int state;
+    unsigned stamp; // when the pair was last activated or matched
+} pass_entry;
+
+#define PASS_SMALL 8
+
+// A validation pass over the tables reached from a checked value: each (table, schema) pair is
+// checked at most once, and the cycles end on the pairs being checked. The entries are kept in
+// order of insertion, followed by an open addressing hash table of their indices; past the first
+// PASS_SMALL entries, they move to an arena anchored in the registry.
+struct schema_pass
+{
+    int capacity;       // number of entries of the arena; the hash table has 2 * capacity slots
+    int count;          // number of entries
+    int depth;          // number of schemas being checked
+    int max_depth;      // the depth limit
+    int depth_failures; // number of times the depth limit has been hit
+    unsigned clock;     // the last stamp
+    pass_entry *entries;
+    int *slots; // -1 if empty
+    pass_entry small_entries[PASS_SMALL];
+    int small_slots[2 * PASS_SMALL];
+};
+
+static void pass_init(schema_pass *pass, int max_depth)
+{
+    pass->capacity = PASS_SMALL;
+    pass->count = 0;
+    pass->depth = 0;
+    pass->max_depth = max_depth;
+    pass->depth_failures = 0;
+    pass->clock = 0;
+    pass->entries = pass->small_entries;
+    pass->slots = pass->small_slots;
+    for (int i = 0; i < 2 * PASS_SMALL; i++) pass->slots[i] = -1;
+}
+
+static unsigned pass_hash(const void *table, const schema *s, int check_level)
+{
+    uintptr_t h = ((uintptr_t)table >> 3) ^ ((uintptr_t)s >> 3) * 31u ^ (uintptr_t)check_level;
+    return (unsigned)(h ^ (h >> 16)) * 2654435761u;
+}
+
+// returns the slot of the hash table of a pass for a pair, which is empty if the pair is missing.
+static int *pass_slot(const schema_pass *pass, const void *table, const schema *s, int check_level)
+{
+    unsigned mask = 2 * (unsigned)pass->capacity - 1;
+    for (unsigned i = pass_hash(table, s, check_level) & mask;; i = (i + 1) & mask)
+    {
+        int *slot = &pass->slots[i];
+        if (*slot < 0) return slot;
+        const pass_entry *e = &pass->entries[*slot];
+        if (e->table == table && e->s == s && e->check_level == check_level) return slot;
+    }
+}
+
+// moves the entries of a pass to a new arena with room for `capacity` entries.
+static void pass_grow(lua_State *L, schema_pass *pass, int capacity)
+{
+    size_t entries_size = (size_t)capacity * sizeof(pass_entry);
+    pass_entry *entries = (pass_entry *)lua_newuserdata(L, entries_size + 2 * (size_t)capacity * sizeof(int));
+    memcpy(entries, pass->entries, (size_t)pass->count * sizeof(pass_entry));
+    lua_rawsetp(L, LUA_REGISTRYINDEX, &pass_key); // the old arena, if any, is garbage
+    pass->entries = entries;
+    pass->slots = (int *)((char *)entries + entries_size);
+    pass->capacity = capacity;
+    for (int i = 0; i < 2 * capacity; i++) pass->slots[i] = -1;
+    for (int i = 0; i < pass->count; i++)
+    {
+        const pass_entry *e = &entries[i];
+        *pass_slot(pass, e->table, e->s, e->check_level) = i;
+    }
+}
+
+// returns the index of the entry of a pair, or -1 if the pair has not been reached.
+static int pass_find(const schema_pass *pass, const void *table, const schema *s, int check_level)
+{
+    return *pass_slot(pass, table, s, check_level);
+}
+
+// adds a pair to a pass, and returns the index of its entry.
+static int pass_add(lua_State *L, schema_pass *pass, const void *table, const schema *s, int check_level)
+{
+    if (pass->count == pass->capacity) pass_grow(L, pass, 2 * pass->capacity);
+    int i = pass->count++;
+    pass_entry *e = &pass->entries[i];
+    e->table = table;
+    e->s = s;
+    e->check_level = check_level;
+    e->state = PASS_UNKNOWN;
+    *pass_slot(pass, table, s, check_level) = i;
+    return i;
+}
+
+static bool schema_match(lua_State *L, int check_level, schema_pass *pass, bool report, int sch, int idx);
+
+// matches the fields of the table at index `idx` against the schema at index `sch`; on mismatch,
+// if `report` is true, pushes the path of the bad field and the error message.
+static bool schema_match_fields(lua_State *L, int check_level, schema_pass *pass, bool report, int sch, int idx)
+{
+    const schema *s = (const schema *)lua_touserdata(L, sch);
+
+    luaL_checkstack(L, 8, "schema nested too deeply");
+    lua_getuservalue(L, sch); // uv
+    int uv = lua_gettop(L);
+    for (int i = 1; i <= s->count; i++)
+    {
+        lua_rawgeti(L, uv, i);         // uv key
+        lua_pushvalue(L, -1);          // uv key key
+        int type = lua_rawget(L, idx); // uv key value
+
+        const schema_field *f = &s->fields[i - 1];
+        if (f->d != NULL)
+        {
+            if (!report && !descriptor_test(L, check_level, f->d, -1))
+            {
+                lua_settop(L, uv - 1);
+                return false;
+            }
+            if (report && !descriptor_match(L, check_level, f->d, -1)) // uv key value message
+            {
+                push_field_path(L, -3); // uv key value message path
+                lua_insert(L, -2);      // uv key value path message
+                return schema_mismatch(L, uv);
+            }
+            lua_pop(L, 2); // uv
+            continue;
+        }
+
+        lua_rawgeti(L, uv, s->count + i); // uv key value nested
+        const schema *nested = (const schema *)lua_touserdata(L, -1);
+        if (type != LUA_TTABLE)
+        {
+            if (type == LUA_TNIL && nested->optional)
+            {
+                lua_pop(L, 3); // uv
+                continue;
+            }
+            if (!report)
+            {
+                lua_settop(L, uv - 1);
+                return false;
+            }
+            push_field_path(L, -3);                      // uv key value nested path
+            push_table_error(L, type, nested->optional); // uv key value nested path message
+            return schema_mismatch(L, uv);
+        }
+
+        if (!schema_match(L, check_level, pass, report, -1, -2)) // uv key value nested [path message]
+        {
+            if (!report)
+            {
+                lua_settop(L, uv - 1);
+                return false;
+            }
+            const char *path = lua_tostring(L, -2);
+            push_field_path(L, -5);                                         // ... path message parent
+            lua_pushstring(L, *path == '[' || *path == '\0' ? "" : "."); // ... path message parent sep
+            lua_pushvalue(L, -4);                                           // ... path message parent sep path
+            lua_concat(L, 3);                                               // ... path message path
+            lua_replace(L, -3);                                             // ... path message
+            return schema_mismatch(L, uv);
+        }
+        lua_pop(L, 3); // uv
+    }
+    lua_pop(L, 1);
+    return true;
+}
+
+// matches the table at index `idx` against the schema at index `sch` in a validation pass; on
+// mismatch, if `report` is true, pushes the path of the bad field and the error message. The pairs
+// that failed are checked again when reporting, to find the bad field.
+static bool schema_match(lua_State *L, int check_level, schema_pass *pass, bool report, int sch, int idx)
+{
+    sch = lua_absindex(L, sch);
+    idx = lua_absindex(L, idx);
+    const schema *s = (const schema *)lua_touserdata(L, sch);
+    const void *table = lua_topointer(L, idx);
+
+    int i = pass_find(pass, table, s, check_level);
+    if (i >= 0)
+    {
+        int state = pass->entries[i].state;
+        if (state == PASS_ACTIVE || state == PASS_MATCHED) return true;
+        if (state == PASS_FAILED && !report) return false;
+    }
+    if (pass->depth >= pass->max_depth)
+    {
+        pass->depth_failures++;
+        if (report)
+        {
+            lua_pushliteral(L, "");                                                   // path
+            lua_pushfstring(L, "nested deeper than %d levels", pass->max_depth); // path message
+        }
+        return false;
+    }
+
+    if (i < 0) i = pass_add(L, pass, table, s, check_level);
+    pass->entries[i].state = PASS_ACTIVE;
+    unsigned activated = pass->entries[i].stamp = ++pass->clock;
+    int depth_failures = pass->depth_failures;
+
+    pass->depth++;
+    bool matched = schema_match_fields(L, check_level, pass, report, sch, idx);
+    pass->depth--;
+
+    // the arena may have moved, but the indices are stable
+    pass_entry *e = &pass->entries[i];
+    if (matched)
+    {
+        e->state = PASS_MATCHED;
+        e->stamp = ++pass->clock;
+        return true;
+    }
+
+    // a failure past the depth limit depends on the path to the pair
+    e->state = depth_failures == pass->depth_failures ? PASS_FAILED : PASS_UNKNOWN;
+    // the pairs matched since this one was assumed to match are checked again
+    for (int k = 0; k < pass->count; k++)
+    {
+        pass_entry *other = &pass->entries[k];
+        if (other->state == PASS_MATCHED && other->stamp > activated) other->state = PASS_UNKNOWN;
+    }
+    return false;
+}
+
+typedef struct
+{
+    schema_pass *pass;
+    int check_level;
+    bool report;
+    bool matched;
+} schema_call;
+
+static int schema_call_protected(lua_State *L)
+{
+    schema_call *call = (schema_call *)lua_touserdata(L, 1);
+    call->matched = schema_match(L, call->check_level, call->pass, call->report, 2, 3);
+    return call->report && !call->matched ? 2 : 0;
+}
+
+// matches the table at index `idx` against the schema at index `sch` in the running validation
+// pass, or in a new one; on mismatch, if `report` is true, pushes the path of the bad field and the
+// error message. The new pass ends even if a checker raises an error.
+static bool schema_run(lua_State *L, int check_level, bool report, int sch, int idx)
+{
+    context *ctx = get_state_context(L);
+    if (ctx->pass != NULL) return schema_match(L, check_level, ctx->pass, report, sch, idx);
+
+    sch = lua_absindex(L, sch);
+    idx = lua_absindex(L, idx);
+    schema_pass pass;
+    pass_init(&pass, ctx->max_depth);
+    schema_call call = {&pass, check_level, report, false};
+
+    lua_pushcfunction(L, schema_call_protected); // f
+    lua_pushlightuserdata(L, &call);             // f call
+    lua_pushvalue(L, sch);                       // f call sch
+    lua_pushvalue(L, idx);                       // f call sch val
+    ctx->pass = &pass;
+    int status = lua_pcall(L, 3, report ? 2 : 0, 0); // [path message]
+    ctx->pass = NULL;
+
+    lua_pushnil(L);                               // [path message] nil
+    lua_rawsetp(L, LUA_REGISTRYINDEX, &pass_key); // [path message]
+    if (status != LUA_OK) lua_error(L);
+    if (report && call.matched) lua_pop(L, 2);
+    return call.matched;
+}
+
+// the native check of a schema registered as a named type; `ud` is the schema.
+static bool schema_predicate(lua_State *L, int idx, void *ud)
+{
+    int type = lua_type(L, idx);
+    if (type != LUA_TTABLE) return type == LUA_TNIL && ((const schema *)ud)->optional;
+
+    lua_rawgetp(L, LUA_REGISTRYINDEX, &schema_refs_key); // refs
+    lua_rawgetp(L, -1, ud);                              // refs sch
+    bool matched = schema_run(L, CHECKS_FULL, false, -1, idx);
+    lua_pop(L, 2);
+    return matched;
+}
+
+// pushes the message explaining why the table at index `idx` does not match a descriptor whose only
+// named type is a registered schema; returns false, pushing nothing, if the type is not a schema.
+static bool push_schema_error(lua_State *L, const descriptor *d, int idx)
+{
+    idx = lua_absindex(L, idx);
+    lua_rawgetp(L, LUA_REGISTRYINDEX, &natives_key); // natives
+    native_checkers *natives = (native_checkers *)lua_touserdata(L, -1);
+    lua_pop(L, 1);
+
+    const type_name *name = &d->names[0];
+    const native_checker *native = natives_find(natives, name->name, name->len, name->hash);
+    if (native->predicate != schema_predicate) return false;
+
+    lua_rawgetp(L, LUA_REGISTRYINDEX, &schema_refs_key); // refs
+    lua_rawgetp(L, -1, native->ud);                      // refs sch
+    lua_remove(L, -2);                                   // sch
+    if (schema_run(L, CHECKS_FULL, true, -1, idx))
+    {
+        lua_pop(L, 1);
+        return false;
+    }
+    // sch path message
+    if (*lua_tostring(L, -2) != '\0')
+    {
+        lua_pushfstring(L, "field '%s': %s", lua_tostring(L, -2), lua_tostring(L, -1)); // sch path message message
+        lua_replace(L, -4); // message path message
+        lua_pop(L, 2);      // message
+    }
+    else
+    {
+        lua_replace(L, -3); // message path
+        lua_pop(L, 1);      // message
+    }
+    return true;
+}
+
+// registers the schema at index `sch` as the named type `name`; unregisters the schema registered
+// as `name`, if any, when `sch` is 0.
+static void schema_register(lua_State *L, const char *name, int sch)
+{
+    lua_rawgetp(L, LUA_REGISTRYINDEX, &schemas_key); // schemas
+    bool registered = lua_getfield(L, -1, name) != LUA_TNIL;
+    lua_pop(L, 1);
+    if (sch == 0)
+    {
+        if (registered)
+        {
+            lua_pushnil(L);            // schemas nil
+            lua_setfield(L, -2, name); // schemas
+            natives_register(L, name, NULL, NULL);
+        }
+        lua_pop(L, 1);
+        return;
+    }
+
+    void *s = lua_touserdata(L, sch);
+    lua_pushvalue(L, sch);     // schemas sch
+    lua_setfield(L, -2, name); // schemas
+    lua_pop(L, 1);
+    lua_rawgetp(L, LUA_REGISTRYINDEX, &schema_refs_key); // refs
+    lua_pushvalue(L, sch);                               // refs sch
+    lua_rawsetp(L, -2, s);                               // refs
+    lua_pop(L, 1);
+    natives_register(L, name, schema_predicate, s);
+}
+
+/***
+ * Creates a schema, that is a precompiled description of the fields of a table.
+ *
+ * Each field of `fields` maps the name of a field to the descriptor of its type (see
+ * @{check_type}), or to a nested schema, given either as a table of fields or as a schema.
+ * Fields with a descriptor prefixed with `?` are optional.
+ *
+ * A schema registered as a named type with @{register} can be named in the descriptors of its own
+ * fields, describing recursive structures.
+ *
+ * @function schema
+ * @tparam table fields the fields of the schema.
+ * @tparam[opt=false] boolean optional whether the schema accepts `nil` when nested in another schema.
+ * @return the schema.
+ * @usage
+ *    local options = schema { host = 'string', port = 'integer', tls = schema({ cert = 'string' }, true) }
+ *    register('tree', schema { value = 'integer', children = '?{tree}' })
+ */
+static int checks_schema(lua_State *L)
+{
+    luaL_checktype(L, 1, LUA_TTABLE);
+    bool optional = lua_toboolean(L, 2);
+    schema_new(L, 1, optional);
+    return 1;
+}
+
+/***
+ * Checks whether the specified argument of the calling function is a table whose fields match a
+ * schema.
+ *
+ * The fields are checked in a single pass with raw accesses; the error message names the path of
+ * the first bad field found.
+ *
+ * The tables reached from the argument are checked once against each schema, even if they are
+ * shared or form cycles; a table reached again through a cycle is assumed to match. The tables
+ * nested deeper than the limit set with @{set_max_depth} do not match.
+ *
+ * @function check_schema
+ * @tparam integer arg position of the argument to be tested.
+ * @tparam schema schema the schema of the argument (see @{schema}).
+ * @tparam[opt=1] integer level the level in the call stack at which to report the error.
+ * @usage
+ *    local function connect(options)
+ *      check_schema(1, options_schema)
+ *      ...
+ */
+static int checks_check_schema(lua_State *L)
+{
+    int check_level = get_check_level(L, CONTEXT_INDEX);
+    if (check_level == CHECKS_OFF) return 0;
+
+    int arg = (int)luaL_checkinteger(L, 1);
+    const schema *s = (const schema *)luaL_checkudata(L, 2, SCHEMA_TYPE);
+    int level = (int)luaL_optinteger(L, 3, 1);
+
+    lua_Debug ar;
+    lua_getstack(L, 1, &ar);
+    if (!lua_getlocal(L, &ar, arg))
+    {
+        return luaL_argerror(L, 1, "invalid argument index");
+    }
+
+    // val
     int type = lua_type(L, -1);
+    if (type != LUA_TTABLE)
+    {
+        if (type == LUA_TNIL && s->optional) return 0;
+        push_table_error(L, type, s->optional);
+        return errorL_argerror(L, level, arg, lua_tostring(L, -1));
+    }
+
+    if (schema_run(L, check_level, false, 2, -1)) return 0;
+    if (schema_run(L, check_level, true, 2, -1)) return 0; // val path message
+    if (*lua_tostring(L, -2) == '\0') return errorL_argerror(L, level, arg, lua_tostring(L, -1));
+    lua_pushfstring(L, "field '%s': %s", lua_tostring(L, -2), lua_tostring(L, -1));
+    return errorL_argerror(L, level, arg, lua_tostring(L, -1));
+}
+
+/***
+ * Sets the maximum nesting of the schemas checked in a validation pass.
+ *
+ * A table nested deeper than the limit, counting the argument as the first level, does not match
+ * its schema; the limit bounds the recursion of the checks of recursive schemas.
+ *
+ * @function set_max_depth
+ * @tparam integer depth the maximum depth, from 1 to 1000; the default is 100.
+ */
+static int checks_set_max_depth(lua_State *L)
+{
+    context *ctx = (context *)lua_touserdata(L, CONTEXT_INDEX);
+    lua_Integer depth = luaL_checkinteger(L, 1);
+    luaL_argcheck(L, depth > 0 && depth <= SCHEMA_MAX_DEPTH_LIMIT, 1, "depth out of range");
+    ctx->max_depth = (int)depth;
+    return 0;
+}
+
+/**
+ * Raises an error reporting a problem with the argument of the calling function at the specified
+ * position.
+ *
+ * This function never returns.
+ *
+ * @function arg_error
+ * @tparam integer arg the argument position.
+ * @tparam[opt] string message additional text to use as comment.
+ * @tparam[opt=1] integer level the level in the call stack at which to report the error.
+ * @usage
+ *    local function foo(x)
+ *      arg_error(1, "message...")
+ *      ...
+ */
+static int checks_arg_error(lua_State *L)
+{
+    int arg = (int)luaL_checkinteger(L, 1);
+    const char *extramsg = luaL_optstring(L, 2, NULL);
+    int level = (int)luaL_optinteger(L, 3, 1);
+    if (level > 0)
+    {
+        errorL_argerror(L, level, arg, extramsg);
+    }
+    return 0;
+}
+
+/**
+ * Raises an error reporting a problem with the type of the argument of the calling function at the specified
+ * position.
+ *
+ * This function never returns.
+ *
+ * @function type_error
+ * @tparam integer arg the argument position.
+ * @tparam string expected the expected type.
+ * @tparam[opt=1] integer level the level in the call stack at which to report the error.
+ * @usage
+ *    local function foo(x)
+ *      type_error(1, "integer")
+ *      ...
+ */
+static int checks_type_error(lua_State *L)
+{
+    int arg = (int)luaL_checkinteger(L, 1);
+    size_t expected_len;
+    const char *expected = luaL_checklstring(L, 2, &expected_len);
+    int level = (int)luaL_optinteger(L, 3, 1);
+    if (level > 0)
+    {
+        lua_Debug ar;
+        lua_getstack(L, 1, &ar);
+        if (!lua_getlocal(L, &ar, arg))
+        {
+            return luaL_argerror(L, 1, "invalid argument index");
+        }
+
+        int type = lua_type(L, arg);
+        push_type_error(L, type, expected, expected_len);
+    }
+    return 0;
+}
+
+/**
+ * Raises an error reporting a problem with the argument of the calling function at the specified
+ * position if the given condition is not satisfied.
+ *
+ * @function check_arg
+ * @tparam integer arg the position of the argument to be tested.
+ * @tparam bool condition condition to check.
+ * @tparam[opt] string message additional text to use as comment.
+ * @tparam[opt=1] integer level the level in the call stack at which to report the error.
+ * @usage
+ *    local function foo(t, filter)
+ *      check_type(1, 'table')
+ *      check_arg(1, #t > 0, "empty table")
+ *      ...
+ */
+static int checks_check_arg(lua_State *L)
+{
+    if (stats_enter((context *)lua_touserdata(L, CONTEXT_INDEX))) return stats_call(L, STATS_CHECK_ARG, checks_check_arg);
 
-    const char *p = expected;
-    const char *e = expected + expected_len;
-    if (*p == '?')
+    if (get_check_level(L, CONTEXT_INDEX) == CHECKS_OFF) return 0;
+
+    int arg = (int)luaL_checkinteger(L, 1);
+    int cond = lua_toboolean(L, 2);
+    const char *extramsg = luaL_optstring(L, 3, NULL);
+    int level = (int)luaL_optinteger(L, 4, 1);
+    if (level > 0 && !cond)
     {
-        if (type == LUA_TNIL) return 1;
-        if (++p == e) return 0;
+        stats_failure((context *)lua_touserdata(L, CONTEXT_INDEX));
+        errorL_argerror(L, level, arg, extramsg);
     }
+    return 0;
+}
 
-    if (type_match(L, type, p, e)) return 1; // <empty>
-    push_type_error(L, type, expected, expected_len);
-    return errorL_argerror(L, level, arg, lua_tostring(L, -1));
+/**
+ * Register a custom check function for a given type descriptor.
+ *
+ * Passing `nil` as the custom check function will unregister the custom check.
+ *
+ * A check declared `pure` must depend only on the contents of the value it checks: its results for
+ * tables and userdata are then cached, until the value is collected or the results are discarded
+ * with @{invalidate}, and repeated checks of the same value do not call it again. Its cache hits
+ * and misses are reported by @{stats}.
+ *
+ * The check can also be a schema (see @{schema}), which is then matched natively against the
+ * tables of the named type; the schema can name the type in its own fields.
+ *
+ * The names of the native checks, built in, such as `array` or `utf8`, or registered by C modules
+ * through the interface in `ldk_checks.h`, cannot be registered with this function, unless as a
+ * schema replacing another schema.
+ *
+ * @function register
+ * @tparam string descriptor the type descriptor to register a check function for.
+ * @tparam function|schema check the custom check function, or a schema.
+ * @tparam[opt] table options the options of a check function: `pure`, whether its results can be
+ * cached.
+ */
+static int checks_register(lua_State *L)
+{
+    size_t descriptor_len;
+    const char *descriptor = luaL_checklstring(L, 1, &descriptor_len);
+
+    if (descriptor_len == 0)
+    {
+        return luaL_argerror(L, 1, "name is empty");
+    }
+
+    if (luaL_testudata(L, 2, SCHEMA_TYPE))
+    {
+        // a schema replaces another schema, but not the other native checks
+        ldk_checks_predicate predicate = natives_get(L, descriptor, descriptor_len);
+        if (predicate != NULL && predicate != schema_predicate)
+        {
+            return luaL_argerror(L, 1, "name taken by a native check");
+        }
+        schema_register(L, descriptor, 2);
+        return 0;
+    }
+    schema_register(L, descriptor, 0);
+
+    if (lua_isnil(L, 2))
+    {
+        lua_rawgetp(L, LUA_REGISTRYINDEX, &checkers_key); // checkers
+        lua_pushnil(L);                                   // checkers nil
+        lua_setfield(L, -2, descriptor);                  // checkers
+        lua_pop(L, 1);
+        return 0;
+    }
+
+    luaL_checktype(L, 2, LUA_TFUNCTION);
+    // the native checks are tried first, so a function registered with their name is never called
+    if (natives_get(L, descriptor, descriptor_len) != NULL)
+    {
+        return luaL_argerror(L, 1, "name taken by a native check");
+    }
+    bool pure = false;
+    if (!lua_isnoneornil(L, 3))
+    {
+        luaL_checktype(L, 3, LUA_TTABLE);
+        lua_getfield(L, 3, "pure");
+        pure = lua_toboolean(L, -1);
+        lua_pop(L, 1);
+    }
+
+    lua_rawgetp(L, LUA_REGISTRYINDEX, &checkers_key); // checkers
+    if (pure)
+    {
+        context *ctx = (context *)lua_touserdata(L, CONTEXT_INDEX);
+        pure_checker *checker = (pure_checker *)lua_newuserdata(L, sizeof(pure_checker)); // checkers pure
+        checker->id = ++ctx->pure_count;
+        checker->hits = 0;
+        checker->misses = 0;
+        lua_pushvalue(L, 2);     // checkers pure function
+        lua_setuservalue(L, -2); // checkers pure
+    }
+    else
+    {
+        lua_pushvalue(L, 2); // checkers function
+    }
+    lua_setfield(L, -2, descriptor); // checkers
+    lua_pop(L, 1);
+    return 0;
 }
 
 /***
- * Checks whether the specified argument of the calling function is of any of the types specified in
- * the given descriptor.
+ * Discards the cached results of the pure checks.
  *
- * The type of the argument at position `arg` must match one of the types in `expected.
+ * Given a value, discards the results for that value only; given no value or `nil`, discards all
+ * of them, and also the names of the functions looked up in `package.loaded` for the error
+ * messages: call it after adding, renaming or unloading modules.
+ * Call it after mutating a value checked by a pure check (see @{register}).
  *
- * Each type can be the name of a primitive Lua type:
+ * Given a metatable, also discards the `__type` and `__name` fields read from it (see
+ * @{check_type}); call it after changing those fields.
  *
- * * `nil`
- * * `boolean`
- * * `userdata`
- * * `number`
- * * `string`
- * * `table`
- * * `function`
- * * `thread`
+ * @function invalidate
+ * @tparam[opt] table|userdata value the value whose results are discarded.
+ */
+static int checks_invalidate(lua_State *L)
+{
+    if (lua_isnoneornil(L, 1))
+    {
+        context *ctx = (context *)lua_touserdata(L, CONTEXT_INDEX);
+        ctx->generation++;
+        errorL_forgetnames(L);
+        return 0;
+    }
+    int type = lua_type(L, 1);
+    if (type != LUA_TTABLE && type != LUA_TUSERDATA)
+    {
+        return luaL_argerror(L, 1, lua_pushfstring(L, "table or userdata expected, got %s", luaL_typename(L, 1)));
+    }
+
+    static const char *const caches[] = {&memo_key, &table_names_key, &userdata_names_key};
+    for (size_t i = 0; i < sizeof(caches) / sizeof(caches[0]); i++)
+    {
+        lua_rawgetp(L, LUA_REGISTRYINDEX, caches[i]); // cache
+        lua_pushvalue(L, 1);                          // cache val
+        lua_pushnil(L);                               // cache val nil
+        lua_rawset(L, -3);                            // cache
+        lua_pop(L, 1);
+    }
+    return 0;
+}
+
+// unregisters the name of the class whose metatable is the one at index `mt`, if it is still the
+// name of that class.
+static void class_unname(lua_State *L, int mt)
+{
+    mt = lua_absindex(L, mt);
+    lua_rawgetp(L, LUA_REGISTRYINDEX, &classes_key); // classes
+    lua_pushvalue(L, mt);                            // classes mt
+    if (lua_rawget(L, -2) == LUA_TUSERDATA)          // classes class
+    {
+        lua_getuservalue(L, -1);       // classes class uv
+        lua_rawgeti(L, -1, CLASS_NAME); // classes class uv name
+        lua_remove(L, -2);              // classes class name
+        size_t len;
+        const char *name = lua_tolstring(L, -1, &len);
+        lua_rawgetp(L, LUA_REGISTRYINDEX, &natives_key); // classes class name natives
+        native_checkers *natives = (native_checkers *)lua_touserdata(L, -1);
+        const native_checker *native = natives_find(natives, name, len, str_hash(name, len));
+        lua_pop(L, 1); // classes class name
+        if (native->predicate == class_predicate && native->ud == lua_topointer(L, mt))
+        {
+            natives_register(L, name, NULL, NULL);
+        }
+        lua_pop(L, 1); // classes class
+    }
+    lua_pop(L, 2);
+}
+
+/***
+ * Declares a class, whose instances match the descriptors naming the class or any of its
+ * ancestors.
  *
- * one of the following options:
+ * A class is identified by the metatable of its instances, tables or userdata; its ancestry is
+ * recorded when it is declared, so a class is declared after its parent, and redeclaring a class
+ * does not change the ancestry of its subclasses. Instances are matched by metatable, whatever
+ * their `__type` or `__name` fields, and values that are not instances do not match the name of a
+ * class, whatever their fields.
  *
- * * `any` (accepts any non-nil argument type)
- * * `file` (accepts a file object)
- * * `integer` (accepts an integer number)
- * * `float` (accepts a floating point number)
- * * an arbitrary string, matched against the content of the `__type` or `__name` field of the
- * argument's metatable if the argument is table or a userdata, respectively.
+ * Classes take precedence over the checks registered with @{register}; a class cannot be named
+ * like a native check, such as `array` or `utf8`, unless it is another class. Passing `nil` as the
+ * name undeclares the class.
  *
- * Multiple values can be accepted if concatenated with a bar `|`:
+ * @usage
+ * checks.class(Shape, 'Shape')
+ * checks.class(Circle, 'Circle', Shape)
  *
- *    check_type(1, 'integer|table') -- matches an integer or a table
+ * function Shape:move(dx, dy)
+ *   checks.check_types('Shape', 'number', 'number') -- accepts circles
+ * end
  *
- * A `nil` value can be matched by prefixing the type descriptor with `?`:
+ * @function class
+ * @tparam table mt the metatable of the instances of the class.
+ * @tparam string|nil name the name of the class in the descriptors, or `nil`.
+ * @tparam[opt] table parent the metatable of the parent class, declared with this function.
+ */
+static int checks_class(lua_State *L)
+{
+    luaL_checktype(L, 1, LUA_TTABLE);
+    const void *mt = lua_topointer(L, 1);
+
+    if (lua_isnil(L, 2))
+    {
+        class_unname(L, 1);
+        lua_rawgetp(L, LUA_REGISTRYINDEX, &classes_key); // classes
+        lua_pushvalue(L, 1);                             // classes mt
+        lua_pushnil(L);                                  // classes mt nil
+        lua_rawset(L, -3);                               // classes
+        lua_pop(L, 1);
+        return 0;
+    }
+
+    size_t name_len;
+    const char *name = luaL_checklstring(L, 2, &name_len);
+    if (name_len == 0)
+    {
+        return luaL_argerror(L, 2, "name is empty");
+    }
+    ldk_checks_predicate predicate = natives_get(L, name, name_len);
+    if (predicate != NULL && predicate != class_predicate)
+    {
+        return luaL_argerror(L, 2, "name taken by a native check");
+    }
+
+    const class_info *parent = NULL;
+    if (!lua_isnoneornil(L, 3))
+    {
+        luaL_checktype(L, 3, LUA_TTABLE);
+        parent = class_find(L, 3);
+        if (parent == NULL)
+        {
+            return luaL_argerror(L, 3, "not a class");
+        }
+        if (class_is(parent, mt)) return luaL_argerror(L, 3, "cyclic ancestry");
+    }
+
+    class_unname(L, 1);
+    size_t count = parent != NULL ? parent->count + 1 : 1;
+    class_info *c = (class_info *)lua_newuserdata(L, sizeof(class_info) + count * sizeof(const void *)); // c
+    c->count = count;
+    c->ancestors[0] = mt;
+    if (parent != NULL)
+    {
+        memcpy(c->ancestors + 1, parent->ancestors, parent->count * sizeof(const void *));
+    }
+    lua_createtable(L, (int)count + 1, 0); // c uv
+    lua_pushvalue(L, 2);                   // c uv name
+    lua_rawseti(L, -2, CLASS_NAME);        // c uv
+    lua_pushvalue(L, 1);                   // c uv mt
+    lua_rawseti(L, -2, CLASS_ANCESTORS);   // c uv
+    if (parent != NULL)
+    {
+        lua_rawgetp(L, LUA_REGISTRYINDEX, &classes_key); // c uv classes
+        lua_pushvalue(L, 3);                             // c uv classes parent
+        lua_rawget(L, -2);                               // c uv classes pc
+        lua_getuservalue(L, -1);                         // c uv classes pc puv
+        for (int i = 0; i < (int)parent->count; i++)
+        {
+            lua_rawgeti(L, -1, CLASS_ANCESTORS + i);     // c uv classes pc puv ancestor
+            lua_rawseti(L, -5, CLASS_ANCESTORS + 1 + i); // c uv classes pc puv
+        }
+        lua_pop(L, 3); // c uv
+    }
+    lua_setuservalue(L, -2);                         // c
+    lua_rawgetp(L, LUA_REGISTRYINDEX, &classes_key); // c classes
+    lua_pushvalue(L, 1);                             // c classes mt
+    lua_pushvalue(L, -3);                            // c classes mt c
+    lua_rawset(L, -3);                               // c classes
+    lua_pop(L, 2);
+
+    natives_register(L, name, class_predicate, (void *)mt);
+    return 0;
+}
+
+// the C descriptors compiled past this many are not cached
+#define C_DESCRIPTORS_MAX 1024
+
+// pushes the compiled form of a descriptor given as a C string constant, compiling it on first use;
+// returns NULL, pushing nothing, if the descriptor is invalid. The cache is keyed on the address of
+// the string, which is trusted to hold the same text on each use.
+static const descriptor *c_descriptor_push(lua_State *L, context *ctx, const char *text)
+{
+    lua_rawgetp(L, LUA_REGISTRYINDEX, &c_descriptors_key); // descriptors
+    if (lua_rawgetp(L, -1, text) == LUA_TUSERDATA)          // descriptors descriptor
+    {
+        lua_remove(L, -2); // descriptor
+        return (const descriptor *)lua_touserdata(L, -1);
+    }
+    lua_pop(L, 1); // descriptors
+
+    const descriptor *d = descriptor_compile(L, text, strlen(text)); // descriptors descriptor
+    if (d == NULL)
+    {
+        lua_pop(L, 1);
+        return NULL;
+    }
+    if (ctx->c_descriptor_count < C_DESCRIPTORS_MAX)
+    {
+        ctx->c_descriptor_count++;
+        lua_pushvalue(L, -1);     // descriptors descriptor descriptor
+        lua_rawsetp(L, -3, text); // descriptors descriptor
+    }
+    lua_remove(L, -2); // descriptor
+    return d;
+}
+
+// checks an argument of a C function against a compiled descriptor; `idx` is 0 for a missing
+// argument.
+static void api_check_one(lua_State *L, int check_level, int arg, const descriptor *d, int idx)
+{
+    if (idx != 0)
+    {
+        type_check_one(L, check_level, 0, arg, d, idx);
+    }
+    else if (!(d->mask & TYPE_BIT(LUA_TNIL)))
+    {
+        type_error(L, check_level, 0, arg, d, 0);
+    }
+}
+
+// returns the context of the state, raising an error if the library has not been loaded in it: the
+// interface can be reached from a state other than the one it was looked up in.
+static context *api_context(lua_State *L)
+{
+    context *ctx = get_state_context(L);
+    if (ctx == NULL)
+    {
+        lua_pushliteral(L, "ldk.checks is not loaded");
+        lua_error(L);
+    }
+    return ctx;
+}
+
+static void api_register_predicate(lua_State *L, const char *name, ldk_checks_predicate predicate, void *ud)
+{
+    api_context(L);
+    natives_register(L, name, predicate, ud);
+}
+
+static void api_checktype(lua_State *L, int arg, const char *expected)
+{
+    context *ctx = api_context(L);
+    int check_level = ctx->check_level;
+    if (check_level == CHECKS_OFF) return;
+
+    // the descriptor stays on the stack during the check, which keeps an uncached one alive
+    int top = lua_gettop(L);
+    arg = lua_absindex(L, arg);
+    int idx = arg > top ? 0 : arg;
+    const descriptor *d = c_descriptor_push(L, ctx, expected); // descriptor
+    if (d == NULL || d->repeat)
+    {
+        luaL_error(L, "invalid descriptor '%s'", expected);
+    }
+    if (ctx->stats_mode == STATS_OFF)
+    {
+        api_check_one(L, check_level, arg, d, idx);
+        lua_pop(L, 1);
+        return;
+    }
+
+    stats_frame saved;
+    stats_begin(L, ctx, STATS_C_CHECKTYPE, &saved);
+    api_check_one(L, check_level, arg, d, idx);
+    stats_end(ctx, &saved);
+    lua_pop(L, 1);
+}
+
+static const signature *api_newsignature(lua_State *L, int n, const char *const descriptors[])
+{
+    api_context(L);
+    luaL_checkstack(L, n + LUA_MINSTACK, "too many descriptors");
+    int first = lua_gettop(L) + 1;
+    for (int i = 0; i < n; i++)
+    {
+        lua_pushstring(L, descriptors[i]);
+    }
+
+    int i = signature_new(L, first, n); // descriptors... sig
+    if (i != 0)
+    {
+        luaL_error(L, "invalid descriptor '%s'", descriptors[i - 1]);
+    }
+    if (n > 0)
+    {
+        lua_replace(L, first); // sig descriptors...
+        lua_settop(L, first);  // sig
+    }
+    return (const signature *)lua_touserdata(L, -1);
+}
+
+static void api_checktypes(lua_State *L, const signature *sig)
+{
+    context *ctx = api_context(L);
+    int check_level = ctx->check_level;
+    if (check_level == CHECKS_OFF) return;
+
+    if (ctx->stats_mode == STATS_OFF)
+    {
+        signature_check_stack(L, check_level, sig, 0, lua_gettop(L));
+        return;
+    }
+
+    stats_frame saved;
+    stats_begin(L, ctx, STATS_C_CHECKTYPES, &saved);
+    signature_check_stack(L, check_level, sig, 0, lua_gettop(L));
+    stats_end(ctx, &saved);
+}
+
+static const ldk_checks_api api = {
+    LDK_CHECKS_API_VERSION, //
+    api_register_predicate, //
+    api_checktype,          //
+    api_newsignature,       //
+    api_checktypes,         //
+};
+
+static int checks_noop(lua_State *L)
+{
+    (void)L;
+    return 0;
+}
+
+// clang-format off
+static const struct luaL_Reg check_funcs[] =
+{
+#define XX(name) { #name, checks_ ##name },
+    XX(check_arg)
+    XX(check_option)
+    XX(check_type)
+    XX(check_types)
+    { NULL, NULL }
+#undef XX
+};
+
+static const struct luaL_Reg noop_funcs[] =
+{
+#define XX(name) { #name, checks_noop },
+    XX(check_arg)
+    XX(check_option)
+    XX(check_type)
+    XX(check_types)
+    { NULL, NULL }
+#undef XX
+};
+//clang-format on
+
+// exports no-op check functions when all the checks are off, and the actual ones otherwise.
+static void update_exports(lua_State *L, int ctx)
+{
+    const context *c = (const context *)lua_touserdata(L, ctx);
+    lua_getuservalue(L, ctx);        // uv
+    lua_rawgeti(L, -1, CONTEXT_LIB); // uv lib
+    lua_pushvalue(L, ctx);           // uv lib ctx
+    luaL_setfuncs(L, c->check_level == CHECKS_OFF && c->module_count == 0 ? noop_funcs : check_funcs, 1);
+    lua_pop(L, 2);
+}
+
+/***
+ * Sets the level of the checks performed by the library.
+ *
+ * The level can be one of:
+ *
+ * * `off`: no check is performed;
+ * * `primitive`: only the primitive types are checked; named types and registered checks accept any
+ *   non-nil value, and options accept any string;
+ * * `full`: all the checks are performed (the default).
+ *
+ * If a module name is given, the level applies only to the checks performed by the functions
+ * defined in the file of that module; passing `nil` as the level removes the module's own level.
+ *
+ * When all the checks are off, the check functions of the library are replaced by functions doing
+ * nothing; functions stored elsewhere return immediately.
+ *
+ * @function set_level
+ * @tparam string level the check level.
+ * @tparam[opt] string module the name of the module the level applies to.
+ * @usage
+ *    set_level('primitive')
+ *    set_level('full', 'my.module')
+ */
+static int checks_set_level(lua_State *L)
+{
+    context *ctx = (context *)lua_touserdata(L, CONTEXT_INDEX);
+    if (lua_isnoneornil(L, 2))
+    {
+        ctx->check_level = luaL_checkoption(L, 1, NULL, check_levels);
+    }
+    else
+    {
+        luaL_checkstring(L, 2);
+        lua_getuservalue(L, CONTEXT_INDEX);  // uv
+        lua_rawgeti(L, -1, CONTEXT_MODULES); // uv modules
+        lua_pushvalue(L, 2);                 // uv modules name
+        if (lua_isnil(L, 1))
+        {
+            lua_pushnil(L); // uv modules name nil
+        }
+        else
+        {
+            lua_pushinteger(L, luaL_checkoption(L, 1, NULL, check_levels)); // uv modules name level
+        }
+        lua_rawset(L, -3); // uv modules
+
+        int module_count = 0;
+        for (lua_pushnil(L); lua_next(L, -2); lua_pop(L, 1)) module_count++;
+        ctx->module_count = module_count;
+        lua_pop(L, 2);
+    }
+
+    lua_getuservalue(L, CONTEXT_INDEX); // uv
+    new_weak_table(L, "k");             // uv functions
+    lua_rawseti(L, -2, CONTEXT_FUNCTIONS);
+    lua_pop(L, 1);
+
+    update_exports(L, CONTEXT_INDEX);
+    return 0;
+}
+
+/***
+ * Sets how the failed checks are reported.
+ *
+ * The mode can be one of:
+ *
+ * * `string`: the checks raise the usual error messages (the default);
+ * * `object`: the type checks raise an error object, which formats the message only when converted
+ *   to a string, and has the fields `arg`, `expected`, `got`, `value`, `message`, `name`, `source`
+ *   and `line`.
+ *
+ * The object mode makes failing checks cheaper when the errors are caught and not printed.
+ *
+ * @function set_error_mode
+ * @tparam string mode the error mode.
+ * @usage
+ *    set_error_mode('object')
+ *    local ok, err = pcall(f, x)
+ *    if not ok and err.arg == 1 then ... end
+ */
+static int checks_set_error_mode(lua_State *L)
+{
+    context *ctx = (context *)lua_touserdata(L, CONTEXT_INDEX);
+    ctx->error_mode = luaL_checkoption(L, 1, NULL, error_modes);
+    return 0;
+}
+
+/***
+ * Sets whether the checks are counted.
  *
- *     checktype(1, '?table') -- matches a table or nil
+ * The mode can be one of:
  *
- * Finally, if a descriptor is prefixed with `:`, the function will behave like @{check_option}.
+ * * `off`: nothing is counted (the default);
+ * * `on`: the calls and the failures of the checks are counted per check function and per call
+ *   site;
+ * * `timing`: as `on`, and the time spent in the checks is measured too.
  *
- *     checktype(1, ':one|two') -- matches 'one' or 'two'
+ * In both `on` and `timing`, the matches of named types and the calls to registered checks are
+ * counted too, per descriptor and per call site. The counters are returned by @{stats}.
  *
- * @remark Prefixes are processed in order: first `:` then `?`.
- * @function check_type
- * @tparam integer arg position of the argument to be tested.
- * @tparam string expected the descriptor of the expected type.
- * @tparam[opt=1] integer level the level in the call stack at which to report the error.
+ * @function set_stats
+ * @tparam string mode the stats mode.
  * @usage
- *    local function foo(t, filter)
- *      check_type(1, 'table')
- *      check_type(2, '?function')
- *      ...
+ *    set_stats('timing')
  */
-static int checks_check_type(lua_State *L)
+static int checks_set_stats(lua_State *L)
 {
-    int arg = (int)luaL_checkinteger(L, 1);
+    context *ctx = (context *)lua_touserdata(L, CONTEXT_INDEX);
+    ctx->stats_mode = luaL_checkoption(L, 1, NULL, stats_modes);
+    ctx->stats_entered = false;
+    ctx->site = NULL;
+    ctx->active = NULL;
+    return 0;
+}
 
-    size_t expected_len;
-    const char *expected = luaL_checklstring(L, 2, &expected_len);
-    if (expected_len == 0)
+// pushes the counters of a check function or, with `is_site`, of a call site.
+static void push_check_stats(lua_State *L, const check_stats *stats, bool timing, bool is_site)
+{
+    lua_createtable(L, 0, 5); // stats
+    lua_pushinteger(L, stats->calls);
+    lua_setfield(L, -2, "calls");
+    lua_pushinteger(L, stats->failures);
+    lua_setfield(L, -2, "failures");
+    if (timing)
     {
-        return luaL_argerror(L, 2, "empty descriptor");
+        lua_pushinteger(L, (lua_Integer)stats->time);
+        lua_setfield(L, -2, "time");
     }
-    int level = (int)luaL_optinteger(L, 3, 1);
-
-    lua_Debug ar;
-    lua_getstack(L, 1, &ar);
-    if (!lua_getlocal(L, &ar, arg))
+    if (is_site)
     {
-        return luaL_argerror(L, 1, "invalid argument index");
+        lua_pushinteger(L, stats->slow_hits);
+        lua_setfield(L, -2, "slow");
+        lua_pushinteger(L, stats->checker_calls);
+        lua_setfield(L, -2, "checkers");
     }
+}
 
-    // val
-    if (type_check_one(L, level, arg, expected, expected_len)) return 0;
-    return luaL_argerror(L, 2, "invalid descriptor");
+// adds the counters of the descriptors in the cache at index `cache` to the table at the top.
+static void add_descriptor_stats(lua_State *L, int cache)
+{
+    // t
+    for (lua_pushnil(L); lua_next(L, cache); lua_pop(L, 1)) // t k d
+    {
+        const descriptor *d = (const descriptor *)lua_touserdata(L, -1);
+        if (d == NULL || (d->slow_hits == 0 && d->checker_calls == 0)) continue;
+
+        lua_Integer slow_hits = 0;
+        lua_Integer checker_calls = 0;
+        lua_pushlstring(L, d->text, d->text_len); // t k d text
+        if (lua_rawget(L, -4) == LUA_TTABLE)      // t k d stats
+        {
+            lua_getfield(L, -1, "slow");
+            slow_hits = lua_tointeger(L, -1);
+            lua_getfield(L, -2, "checkers");
+            checker_calls = lua_tointeger(L, -1);
+            lua_pop(L, 2);
+        }
+        lua_pop(L, 1); // t k d
+
+        lua_pushlstring(L, d->text, d->text_len); // t k d text
+        lua_createtable(L, 0, 2);                 // t k d text stats
+        lua_pushinteger(L, slow_hits + d->slow_hits);
+        lua_setfield(L, -2, "slow");
+        lua_pushinteger(L, checker_calls + d->checker_calls);
+        lua_setfield(L, -2, "checkers");
+        lua_rawset(L, -5); // t k d
+    }
 }
 
 /***
- * Checks whether the arguments of the calling function are of the specified types.
+ * Returns the counters of the checks.
  *
- * The last descriptor can be prefixed with:
+ * The returned table has the fields:
  *
- * -  a `*` to make it match zero more more arguments.
- * -  a `+` to make it match one more more arguments.
+ * * `functions`: the counters of each check function, keyed on the function name;
+ * * `sites`: the counters of each call site, keyed on `source:line`;
+ * * `descriptors`: for each descriptor, the number of matches that went past the primitive types
+ *   (`slow`) and the number of calls to registered checks (`checkers`);
+ * * `checkers`: for each pure registered check, the number of results found in its cache (`hits`)
+ *   and the number of results computed (`misses`);
+ * * `clock`: the unit of the times, when timing.
  *
- * @function check_types
- * @tparam string ... the descriptors of the expected types (see @{check_type}).
- * @tparam[opt=1] integer level the level in the call stack at which to report the error.
- * @usage
- *    local function foo(t, filter)
- *      check_types('table', '?function')
- *      ...
+ * The counters of the functions and of the call sites are `calls`, `failures` and, when timing,
+ * `time`. The time of a check includes the time of the checks it triggers, such as the ones
+ * performed by registered checks. The call sites also count `slow` and `checkers`, as the
+ * descriptors do.
+ *
+ * @function stats
+ * @treturn table the counters.
  */
-static int checks_check_types(lua_State *L)
+static int checks_stats(lua_State *L)
 {
-    int n = lua_gettop(L);
+    const context *ctx = (const context *)lua_touserdata(L, CONTEXT_INDEX);
+    bool timing = ctx->stats_mode == STATS_TIMING;
 
-    int level = 1;
-    if (lua_isinteger(L, -1))
+    lua_createtable(L, 0, 5); // t
+    if (timing)
     {
-        level = lua_tointeger(L, -1);
-        n--;
+        lua_pushliteral(L, STATS_CLOCK_UNIT);
+        lua_setfield(L, -2, "clock");
     }
 
-    lua_Debug ar;
-    lua_getstack(L, 1, &ar);
-
-    char eat_all = 0;
-    size_t expected_len;
-    const char *expected;
-
-    const char *p, *e;
-    int arg = 1;
-    while (arg <= n)
+    lua_createtable(L, 0, STATS_FUNCTION_COUNT); // t functions
+    for (int i = 0; i < STATS_FUNCTION_COUNT; i++)
     {
-        expected = luaL_checklstring(L, arg, &expected_len);
-        if (expected_len == 0)
-        {
-            return luaL_argerror(L, arg, "empty descriptor");
-        }
-
-        p = expected;
-        e = expected + expected_len;
-        if (*p == '*' || *p == '+')
-        {
-            eat_all = *p++;
-            if (p == e)
-            {
-                return luaL_argerror(L, arg, "invalid descriptor");
-            }
-            break;
-        }
-
-        if (!lua_getlocal(L, &ar, arg))
-        {
-            push_type_error(L, LUA_TNONE, expected, expected_len);
-            return errorL_argerror(L, level, arg, lua_tostring(L, -1));
-        }
+        push_check_stats(L, &ctx->functions[i], timing, false); // t functions stats
+        lua_setfield(L, -2, stats_functions[i]);
+    }
+    lua_setfield(L, -2, "functions"); // t
 
-        // val
-        type_check_one(L, level, arg, p, (size_t)(e - p));
-        arg++;
+    lua_newtable(L);                               // t sites
+    lua_rawgetp(L, LUA_REGISTRYINDEX, &sites_key); // t sites counters
+    for (lua_pushnil(L); lua_next(L, -2); lua_pop(L, 1)) // t sites counters key site
+    {
+        lua_pushvalue(L, -2); // t sites counters key site key
+        push_check_stats(L, (const check_stats *)lua_touserdata(L, -2), timing, true);
+        lua_rawset(L, -6); // t sites counters key site
     }
+    lua_pop(L, 1); // t sites
+    lua_setfield(L, -2, "sites");
 
-    if (!eat_all) return 0;
+    lua_newtable(L);      // t descriptors
+    push_descriptors(L);  // t descriptors cache
+    add_descriptor_stats(L, lua_gettop(L));
+    lua_pop(L, 1);
+    lua_rawgetp(L, LUA_REGISTRYINDEX, &c_descriptors_key); // t descriptors cache
+    add_descriptor_stats(L, lua_gettop(L));
+    lua_pop(L, 1);
+    lua_setfield(L, -2, "descriptors"); // t
 
-    int arg_count = arg;
-    while (lua_getlocal(L, &ar, arg)) // checkers val
+    lua_newtable(L);                                  // t checkers
+    lua_rawgetp(L, LUA_REGISTRYINDEX, &checkers_key); // t checkers registered
+    for (lua_pushnil(L); lua_next(L, -2); lua_pop(L, 1)) // t checkers registered name checker
     {
-        type_check_one(L, level, arg++, p, (size_t)(e - p));
+        if (lua_type(L, -1) != LUA_TUSERDATA) continue;
+        const pure_checker *pure = (const pure_checker *)lua_touserdata(L, -1);
+        lua_pushvalue(L, -2);     // t checkers registered name checker name
+        lua_createtable(L, 0, 2); // t checkers registered name checker name stats
+        lua_pushinteger(L, pure->hits);
+        lua_setfield(L, -2, "hits");
+        lua_pushinteger(L, pure->misses);
+        lua_setfield(L, -2, "misses");
+        lua_rawset(L, -6); // t checkers registered name checker
     }
+    lua_pop(L, 1); // t checkers
+    lua_setfield(L, -2, "checkers");
+    return 1;
+}
 
-    int vararg = -1;
-    while (lua_getlocal(L, &ar, vararg--)) // checkers val
+static void reset_descriptor_stats(lua_State *L, int cache)
+{
+    for (lua_pushnil(L); lua_next(L, cache); lua_pop(L, 1)) // k d
     {
-        type_check_one(L, level, arg++, p, (size_t)(e - p));
+        descriptor *d = (descriptor *)lua_touserdata(L, -1);
+        if (d == NULL) continue;
+        d->slow_hits = 0;
+        d->checker_calls = 0;
     }
-
-    if (arg > arg_count || eat_all == '*') return 0;
-    push_type_error(L, LUA_TNONE, expected, expected_len);
-    return errorL_argerror(L, level, arg, lua_tostring(L, -1));
 }
 
-/**
- * Raises an error reporting a problem with the argument of the calling function at the specified
- * position.
- *
- * This function never returns.
+/***
+ * Resets all the counters of the checks.
  *
- * @function arg_error
- * @tparam integer arg the argument position.
- * @tparam[opt] string message additional text to use as comment.
- * @tparam[opt=1] integer level the level in the call stack at which to report the error.
- * @usage
- *    local function foo(x)
- *      arg_error(1, "message...")
- *      ...
+ * @function reset_stats
  */
-static int checks_arg_error(lua_State *L)
+static int checks_reset_stats(lua_State *L)
 {
-    int arg = (int)luaL_checkinteger(L, 1);
-    const char *extramsg = luaL_optstring(L, 2, NULL);
-    int level = (int)luaL_optinteger(L, 3, 1);
-    if (level > 0)
+    context *ctx = (context *)lua_touserdata(L, CONTEXT_INDEX);
+    memset(ctx->functions, 0, sizeof(ctx->functions));
+
+    // the counters of the sites are cleared in place, as running checks may refer to them
+    lua_rawgetp(L, LUA_REGISTRYINDEX, &sites_key);       // sites
+    for (lua_pushnil(L); lua_next(L, -2); lua_pop(L, 1)) // sites key site
     {
-        errorL_argerror(L, level, arg, extramsg);
+        memset(lua_touserdata(L, -1), 0, sizeof(check_stats));
+    }
+    lua_pop(L, 1);
+
+    push_descriptors(L); // cache
+    reset_descriptor_stats(L, lua_gettop(L));
+    lua_pop(L, 1);
+    lua_rawgetp(L, LUA_REGISTRYINDEX, &c_descriptors_key); // cache
+    reset_descriptor_stats(L, lua_gettop(L));
+    lua_pop(L, 1);
+
+    lua_rawgetp(L, LUA_REGISTRYINDEX, &checkers_key);    // checkers
+    for (lua_pushnil(L); lua_next(L, -2); lua_pop(L, 1)) // checkers name checker
+    {
+        if (lua_type(L, -1) != LUA_TUSERDATA) continue;
+        pure_checker *pure = (pure_checker *)lua_touserdata(L, -1);
+        pure->hits = 0;
+        pure->misses = 0;
     }
+    lua_pop(L, 1);
     return 0;
 }
 
-/**
- * Raises an error reporting a problem with the type of the argument of the calling function at the specified
- * position.
+/***
+ * Sets the sampling rate of the checks.
  *
- * This function never returns.
+ * With a sampling rate of `n`, @{check_type}, @{check_types} and @{check_option} check only one in
+ * `n` of the calls from each call site, starting with the first one; the other calls return
+ * immediately. A call site is identified by the calling function and the descriptor, and its calls
+ * are counted in a small table, so distinct sites may occasionally share a counter. A rate of `1`
+ * checks every call (the default).
  *
- * @function type_error
- * @tparam integer arg the argument position.
- * @tparam string expected the expected type.
- * @tparam[opt=1] integer level the level in the call stack at which to report the error.
+ * If a target is given, the rate applies only to the checks performed by the functions defined in
+ * the file of the module with that name, or by the given function; passing `nil` as the rate removes
+ * the target's own rate. A rate of `1` for a target forces full checking for it.
+ *
+ * @function set_sampling
+ * @tparam ?integer n the sampling rate.
+ * @tparam[opt] string|function target the name of the module, or the function, the rate applies to.
  * @usage
- *    local function foo(x)
- *      type_error(1, "integer")
- *      ...
+ *    set_sampling(100)
+ *    set_sampling(1, 'my.module')
  */
-static int checks_type_error(lua_State *L)
+static int checks_set_sampling(lua_State *L)
 {
-    int arg = (int)luaL_checkinteger(L, 1);
-    size_t expected_len;
-    const char *expected = luaL_checklstring(L, 2, &expected_len);
-    int level = (int)luaL_optinteger(L, 3, 1);
-    if (level > 0)
+    context *ctx = (context *)lua_touserdata(L, CONTEXT_INDEX);
+    if (lua_isnoneornil(L, 2))
     {
-        lua_Debug ar;
-        lua_getstack(L, 1, &ar);
-        if (!lua_getlocal(L, &ar, arg))
+        lua_Integer n = luaL_checkinteger(L, 1);
+        luaL_argcheck(L, n >= 1 && n <= INT_MAX, 1, "invalid sampling rate");
+        ctx->sampling = (int)n;
+    }
+    else
+    {
+        if (lua_type(L, 2) != LUA_TSTRING && lua_type(L, 2) != LUA_TFUNCTION)
         {
-            return luaL_argerror(L, 1, "invalid argument index");
+            return luaL_argerror(L, 2, lua_pushfstring(L, "string or function expected, got %s", luaL_typename(L, 2)));
+        }
+        lua_getuservalue(L, CONTEXT_INDEX);   // uv
+        lua_rawgeti(L, -1, CONTEXT_SAMPLING); // uv sampling
+        lua_pushvalue(L, 2);                  // uv sampling target
+        if (lua_isnil(L, 1))
+        {
+            lua_pushnil(L); // uv sampling target nil
+        }
+        else
+        {
+            lua_Integer n = luaL_checkinteger(L, 1);
+            luaL_argcheck(L, n >= 1 && n <= INT_MAX, 1, "invalid sampling rate");
+            lua_pushinteger(L, n); // uv sampling target n
         }
+        lua_rawset(L, -3); // uv sampling
 
-        int type = lua_type(L, arg);
-        push_type_error(L, type, expected, expected_len);
+        int sampling_count = 0;
+        for (lua_pushnil(L); lua_next(L, -2); lua_pop(L, 1)) sampling_count++;
+        ctx->sampling_count = sampling_count;
+        lua_pop(L, 2);
     }
+
+    lua_getuservalue(L, CONTEXT_INDEX); // uv
+    new_weak_table(L, "k");             // uv sampled
+    lua_rawseti(L, -2, CONTEXT_SAMPLED);
+    lua_pop(L, 1);
+    memset(ctx->samples, 0, sizeof(ctx->samples));
     return 0;
 }
 
-/**
- * Raises an error reporting a problem with the argument of the calling function at the specified
- * position if the given condition is not satisfied.
- *
- * @function check_arg
- * @tparam integer arg the position of the argument to be tested.
- * @tparam bool condition condition to check.
- * @tparam[opt] string message additional text to use as comment.
- * @tparam[opt=1] integer level the level in the call stack at which to report the error.
- * @usage
- *    local function foo(t, filter)
- *      check_type(1, 'table')
- *      check_arg(1, #t > 0, "empty table")
- *      ...
- */
-static int checks_check_arg(lua_State *L)
+// sets whether the checks against a compiled descriptor are never sampled out.
+static void force_descriptor(context *ctx, descriptor *d, bool forced)
 {
-    int arg = (int)luaL_checkinteger(L, 1);
-    int cond = lua_toboolean(L, 2);
-    const char *extramsg = luaL_optstring(L, 3, NULL);
-    int level = (int)luaL_optinteger(L, 4, 1);
-    if (level > 0 && !cond)
-    {
-        errorL_argerror(L, level, arg, extramsg);
-    }
-    return 0;
+    if (d->forced == forced) return;
+    d->forced = forced;
+    ctx->forced_count += forced ? 1 : -1;
 }
 
-/**
- * Register a custom check function for a given type descriptor.
+/***
+ * Sets whether the checks against a descriptor are never sampled out.
  *
- * Passing `nil` as the custom check function will unregister the custom check.
+ * The setting applies to @{check_type} and @{check_types}; see @{set_sampling}. An option
+ * descriptor, such as `':one|two'`, also applies to the @{check_option} checks against the same
+ * options.
  *
- * @function register
- * @tparam string descriptor the type descriptor to register a check function for.
- * @tparam function check the custom check function.
+ * @function always_check
+ * @tparam string descriptor the descriptor.
+ * @tparam[opt=true] bool enabled `false` to let the checks against the descriptor be sampled again.
+ * @usage
+ *    set_sampling(100)
+ *    always_check('Connection')
  */
-static int checks_register(lua_State *L)
+static int checks_always_check(lua_State *L)
 {
-    size_t descriptor_len;
-    const char *descriptor = luaL_checklstring(L, 1, &descriptor_len);
-
-    if (descriptor_len == 0)
-    {
-        return luaL_argerror(L, 1, "name is empty");
-    }
+    context *ctx = (context *)lua_touserdata(L, CONTEXT_INDEX);
+    luaL_checkstring(L, 1);
+    bool forced = lua_isnone(L, 2) || lua_toboolean(L, 2);
 
-    if (checkers_ref == LUA_NOREF)
-    {
-        lua_newtable(L);                               // checkers
-        checkers_ref = luaL_ref(L, LUA_REGISTRYINDEX); //
-    }
+    push_descriptors(L);                                            // descriptors
+    descriptor *d = (descriptor *)descriptor_push(L, -1, 1, true); // descriptors descriptor
+    luaL_argcheck(L, d != NULL, 1, "invalid descriptor");
+    force_descriptor(ctx, d, forced);
 
-    if (lua_isnil(L, 2))
+    if (d->is_option && !d->repeat)
     {
-        lua_geti(L, LUA_REGISTRYINDEX, checkers_ref); // checkers
-        lua_pushnil(L);                               // checkers nil
-        lua_setfield(L, -2, descriptor);              // checkers
-        lua_pop(L, 1);
-        return 0;
+        lua_pushstring(L, lua_tostring(L, 1) + 1);                   // descriptors descriptor options
+        descriptor *o = (descriptor *)options_push(L, ctx, -1, true); // descriptors descriptor options [o]
+        if (o != NULL) force_descriptor(ctx, o, forced);
     }
-
-    luaL_checktype(L, 2, LUA_TFUNCTION);
-    lua_geti(L, LUA_REGISTRYINDEX, checkers_ref); // checkers
-    lua_pushvalue(L, 2);                          // checkers function
-    lua_setfield(L, -2, descriptor);              // checkers
-    lua_pop(L, 1);
     return 0;
 }
 
@@ -676,12 +4190,29 @@ static int checks_register(lua_State *L)
 static const struct luaL_Reg funcs[] =
 {
 #define XX(name) { #name, checks_ ##name },
+    XX(always_check)
     XX(arg_error)
     XX(check_arg)
     XX(check_option)
+    XX(check_schema)
     XX(check_type)
     XX(check_types)
+    XX(class)
+    XX(dispatch)
+    XX(invalidate)
+    XX(is)
     XX(register)
+    XX(reset_stats)
+    XX(schema)
+    XX(set_error_mode)
+    XX(set_level)
+    XX(set_max_depth)
+    XX(set_sampling)
+    XX(set_stats)
+    XX(signature)
+    XX(stats)
+    XX(which)
+    XX(wrap)
     { NULL, NULL }
 #undef XX
 };
@@ -689,6 +4220,168 @@ static const struct luaL_Reg funcs[] =
 
 extern int luaopen_ldk_checks(lua_State *L)
 {
-    luaL_newlib(L, funcs);
+    if (lua_rawgetp(L, LUA_REGISTRYINDEX, &c_descriptors_key) != LUA_TTABLE) // descriptors
+    {
+        lua_newtable(L);                                       // nil descriptors
+        lua_rawsetp(L, LUA_REGISTRYINDEX, &c_descriptors_key); // nil
+    }
+    lua_pop(L, 1);
+
+    if (lua_rawgetp(L, LUA_REGISTRYINDEX, &checkers_key) != LUA_TTABLE) // checkers
+    {
+        lua_newtable(L);                                  // nil checkers
+        lua_rawsetp(L, LUA_REGISTRYINDEX, &checkers_key); // nil
+    }
+    lua_pop(L, 1);
+
+    if (lua_rawgetp(L, LUA_REGISTRYINDEX, &descriptors_key) != LUA_TTABLE) // descriptors
+    {
+        lua_newtable(L);                                    // nil descriptors
+        lua_rawsetp(L, LUA_REGISTRYINDEX, &descriptors_key); // nil
+        new_weak_table(L, "v");                                 // nil refs
+        lua_rawsetp(L, LUA_REGISTRYINDEX, &descriptor_refs_key); // nil
+    }
+    lua_pop(L, 1);
+
+    if (lua_rawgetp(L, LUA_REGISTRYINDEX, &options_key) != LUA_TTABLE) // options
+    {
+        lua_newtable(L);                                 // nil options
+        lua_rawsetp(L, LUA_REGISTRYINDEX, &options_key); // nil
+    }
+    lua_pop(L, 1);
+
+    if (lua_rawgetp(L, LUA_REGISTRYINDEX, &natives_key) != LUA_TUSERDATA) // natives
+    {
+        natives_new(L, NATIVES_CAPACITY);                // nil natives
+        lua_newtable(L);                                 // nil natives names
+        lua_setuservalue(L, -2);                         // nil natives
+        lua_rawsetp(L, LUA_REGISTRYINDEX, &natives_key); // nil
+
+        natives_register(L, "array", check_array, NULL);
+        natives_register(L, "ascii", check_ascii, NULL);
+        natives_register(L, "callable", check_callable, NULL);
+        natives_register(L, "nonempty", check_nonempty, NULL);
+        natives_register(L, "positive", check_positive, NULL);
+        natives_register(L, "printable", check_printable, NULL);
+        natives_register(L, "utf8", check_utf8, NULL);
+    }
+    lua_pop(L, 1);
+
+    lua_pushlightuserdata(L, (void *)&api);
+    lua_setfield(L, LUA_REGISTRYINDEX, LDK_CHECKS_API);
+
+    if (lua_rawgetp(L, LUA_REGISTRYINDEX, &table_names_key) != LUA_TTABLE) // names
+    {
+        new_weak_table(L, "k");                              // nil names
+        lua_rawsetp(L, LUA_REGISTRYINDEX, &table_names_key); // nil
+    }
+    lua_pop(L, 1);
+
+    if (lua_rawgetp(L, LUA_REGISTRYINDEX, &userdata_names_key) != LUA_TTABLE) // names
+    {
+        new_weak_table(L, "k");                                 // nil names
+        lua_rawsetp(L, LUA_REGISTRYINDEX, &userdata_names_key); // nil
+    }
+    lua_pop(L, 1);
+
+    if (lua_rawgetp(L, LUA_REGISTRYINDEX, &context_key) != LUA_TUSERDATA) // ctx
+    {
+        lua_pop(L, 1);
+        context *c = (context *)lua_newuserdata(L, sizeof(context)); // ctx
+        c->check_level = CHECKS_FULL;
+        c->module_count = 0;
+        c->error_mode = ERRORS_STRING;
+        c->stats_mode = STATS_OFF;
+        c->stats_entered = false;
+        c->site = NULL;
+        c->active = NULL;
+        c->start = 0;
+        memset(c->functions, 0, sizeof(c->functions));
+        c->sampling = 1;
+        c->sampling_count = 0;
+        c->forced_count = 0;
+        memset(c->samples, 0, sizeof(c->samples));
+        c->max_depth = SCHEMA_MAX_DEPTH;
+        c->pass = NULL;
+        c->generation = 0;
+        c->pure_count = 0;
+        c->c_descriptor_count = 0;
+        c->option_count = 0;
+        c->descriptor_count = 0;
+        lua_createtable(L, 5, 0); // ctx uv
+        lua_newtable(L);          // ctx uv modules
+        lua_rawseti(L, -2, CONTEXT_MODULES);
+        new_weak_table(L, "k"); // ctx uv functions
+        lua_rawseti(L, -2, CONTEXT_FUNCTIONS);
+        lua_newtable(L); // ctx uv sampling
+        lua_rawseti(L, -2, CONTEXT_SAMPLING);
+        new_weak_table(L, "k"); // ctx uv sampled
+        lua_rawseti(L, -2, CONTEXT_SAMPLED);
+        lua_setuservalue(L, -2); // ctx
+        lua_pushvalue(L, -1);    // ctx ctx
+        lua_rawsetp(L, LUA_REGISTRYINDEX, &context_key);
+    }
+    int ctx = lua_gettop(L);
+
+    if (luaL_newmetatable(L, SIGNATURE_TYPE)) // ctx mt
+    {
+        luaL_newlibtable(L, signature_methods); // ctx mt methods
+        lua_pushvalue(L, ctx);                  // ctx mt methods ctx
+        luaL_setfuncs(L, signature_methods, 1); // ctx mt methods
+        lua_setfield(L, -2, "__index");         // ctx mt
+        lua_pushvalue(L, ctx);                  // ctx mt ctx
+        lua_pushcclosure(L, signature_check, 1);
+        lua_setfield(L, -2, "__call");
+    }
+    lua_pop(L, 1); // ctx
+
+    luaL_newmetatable(L, SCHEMA_TYPE); // ctx mt
+    lua_pop(L, 1);                     // ctx
+
+    if (lua_rawgetp(L, LUA_REGISTRYINDEX, &sites_key) != LUA_TTABLE) // ctx sites
+    {
+        lua_newtable(L); // ctx nil sites
+        lua_rawsetp(L, LUA_REGISTRYINDEX, &sites_key);
+    }
+    lua_pop(L, 1); // ctx
+
+    if (lua_rawgetp(L, LUA_REGISTRYINDEX, &schemas_key) != LUA_TTABLE) // ctx schemas
+    {
+        lua_newtable(L); // ctx nil schemas
+        lua_rawsetp(L, LUA_REGISTRYINDEX, &schemas_key);
+        new_weak_table(L, "v"); // ctx nil refs
+        lua_rawsetp(L, LUA_REGISTRYINDEX, &schema_refs_key);
+    }
+    lua_pop(L, 1); // ctx
+
+    if (lua_rawgetp(L, LUA_REGISTRYINDEX, &classes_key) != LUA_TTABLE) // ctx classes
+    {
+        lua_newtable(L); // ctx nil classes
+        lua_rawsetp(L, LUA_REGISTRYINDEX, &classes_key);
+    }
+    lua_pop(L, 1); // ctx
+
+    if (lua_rawgetp(L, LUA_REGISTRYINDEX, &memo_key) != LUA_TTABLE) // ctx memo
+    {
+        new_weak_table(L, "k"); // ctx nil memo
+        lua_rawsetp(L, LUA_REGISTRYINDEX, &memo_key);
+    }
+    lua_pop(L, 1); // ctx
+
+    if (luaL_newmetatable(L, ERROR_TYPE)) // ctx mt
+    {
+        luaL_setfuncs(L, error_methods, 0);
+    }
+    lua_pop(L, 1); // ctx
+
+    luaL_newlibtable(L, funcs); // ctx lib
+    lua_pushvalue(L, ctx);      // ctx lib ctx
+    luaL_setfuncs(L, funcs, 1); // ctx lib
+    lua_getuservalue(L, ctx);   // ctx lib uv
+    lua_pushvalue(L, -2);       // ctx lib uv lib
+    lua_rawseti(L, -2, CONTEXT_LIB);
+    lua_pop(L, 1); // ctx lib
+    update_exports(L, ctx);
+    lua_remove(L, ctx); // lib
     return 1;
 }
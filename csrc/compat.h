@@ -0,0 +1,129 @@
+#pragma once
+
+/*
+ * Compatibility with LuaJIT 2.1.
+ *
+ * The library is written against the Lua 5.3 API; with the Lua 5.1 API of LuaJIT the missing
+ * functions are emulated here. LuaJIT numbers have no integer subtype: a number is an integer if
+ * it has an integral value representable as a 64-bit integer.
+ */
+
+#include <lauxlib.h>
+#include <lua.h>
+#include <lualib.h>
+
+#if LUA_VERSION_NUM < 503
+
+#ifndef LUA_JITLIBNAME
+#error "ldk.checks requires Lua 5.3 or later, or LuaJIT 2.1"
+#endif
+
+#include <math.h>
+#include <stddef.h>
+
+#ifndef LUA_OK
+#define LUA_OK 0
+#endif
+#define LUA_NUMTAGS 9
+#define LUA_LOADED_TABLE "_LOADED"
+
+typedef ptrdiff_t lua_KContext;
+
+// there are no continuations: the callers of lua_callk return the result of the continuation
+#define lua_callk(L, nargs, nresults, ctx, k) ((void)(ctx), (void)(k), lua_call(L, nargs, nresults))
+
+#ifndef luaL_newlibtable
+#define luaL_newlibtable(L, l) lua_createtable(L, 0, sizeof(l) / sizeof((l)[0]) - 1)
+#endif
+
+// `%I` is not supported by lua_pushfstring: integers are formatted as numbers
+#define LUA_INTEGER_FSPEC "%f"
+#define LUA_INTEGER_FARG(i) ((lua_Number)(i))
+
+static inline int compat_absindex(lua_State *L, int idx)
+{
+    return idx > 0 || idx <= LUA_REGISTRYINDEX ? idx : lua_gettop(L) + idx + 1;
+}
+
+static inline int compat_rawget(lua_State *L, int idx)
+{
+    (lua_rawget)(L, idx);
+    return lua_type(L, -1);
+}
+
+static inline int compat_rawgeti(lua_State *L, int idx, lua_Integer n)
+{
+    (lua_rawgeti)(L, idx, (int)n);
+    return lua_type(L, -1);
+}
+
+static inline int compat_getfield(lua_State *L, int idx, const char *k)
+{
+    (lua_getfield)(L, idx, k);
+    return lua_type(L, -1);
+}
+
+static inline int compat_rawgetp(lua_State *L, int idx, const void *p)
+{
+    idx = compat_absindex(L, idx);
+    lua_pushlightuserdata(L, (void *)p);
+    return compat_rawget(L, idx);
+}
+
+static inline void compat_rawsetp(lua_State *L, int idx, const void *p)
+{
+    idx = compat_absindex(L, idx);
+    lua_pushlightuserdata(L, (void *)p); // v p
+    lua_insert(L, -2);                   // p v
+    lua_rawset(L, idx);
+}
+
+static inline int compat_isinteger(lua_State *L, int idx)
+{
+    if (lua_type(L, idx) != LUA_TNUMBER) return 0;
+    lua_Number n = lua_tonumber(L, idx);
+    return n == floor(n) && n >= -9223372036854775808.0 && n < 9223372036854775808.0;
+}
+
+// the uservalue is kept in a table set as the environment of the userdata; a userdata that has
+// no uservalue has the globals as its environment
+static inline int compat_getuservalue(lua_State *L, int idx)
+{
+    lua_getfenv(L, idx); // env
+    if (!lua_istable(L, -1) || lua_rawequal(L, -1, LUA_GLOBALSINDEX))
+    {
+        lua_pop(L, 1);
+        lua_pushnil(L);
+        return LUA_TNIL;
+    }
+    (lua_rawgeti)(L, -1, 1); // env v
+    lua_remove(L, -2);       // v
+    return lua_type(L, -1);
+}
+
+static inline void compat_setuservalue(lua_State *L, int idx)
+{
+    idx = compat_absindex(L, idx);
+    lua_createtable(L, 1, 0); // v env
+    lua_insert(L, -2);        // env v
+    lua_rawseti(L, -2, 1);    // env
+    lua_setfenv(L, idx);
+}
+
+#define lua_absindex compat_absindex
+#define lua_rawlen lua_objlen
+#define lua_rawget compat_rawget
+#define lua_rawgeti compat_rawgeti
+#define lua_getfield compat_getfield
+#define lua_rawgetp compat_rawgetp
+#define lua_rawsetp compat_rawsetp
+#define lua_isinteger compat_isinteger
+#define lua_getuservalue compat_getuservalue
+#define lua_setuservalue compat_setuservalue
+
+#else
+
+#define LUA_INTEGER_FSPEC "%I"
+#define LUA_INTEGER_FARG(i) ((LUAI_UACINT)(i))
+
+#endif
@@ -0,0 +1,90 @@
+#pragma once
+
+/*
+ * C interface of the ldk.checks library.
+ *
+ * The library publishes its C functions in the registry when it is loaded, so C modules can bind
+ * to them at load time without linking against the library:
+ *
+ *    const ldk_checks_api *checks = ldk_checks_getapi(L);
+ *    if (checks == NULL) return luaL_error(L, "ldk.checks is not loaded");
+ *    checks->register_predicate(L, "handle", is_handle, NULL);
+ *
+ * The argument checks work directly on the stack of the calling C function, and report errors
+ * with the same messages as the Lua functions of the library:
+ *
+ *    static int foo(lua_State *L)
+ *    {
+ *        ldk_checktype(L, 1, "?table|userdata");
+ *        ...
+ *    }
+ */
+
+#include <lua.h>
+#include <stdbool.h>
+
+#define LDK_CHECKS_API "ldk.checks.api"
+#define LDK_CHECKS_API_VERSION 1
+
+// A signature created with ldk_checks_api.newsignature.
+typedef struct ldk_checks_signature ldk_checks_signature;
+
+// A native check for a named type: whether the value at index `idx` is of the type.
+// `idx` is an absolute index; the function must leave the stack as it found it.
+typedef bool (*ldk_checks_predicate)(lua_State *L, int idx, void *ud);
+
+// The functions of the interface raise an error when called in a state that has not loaded the
+// library.
+typedef struct
+{
+    int version; // LDK_CHECKS_API_VERSION
+
+    // Registers a native check for the named type `name`; `ud` is passed to each invocation.
+    // Passing NULL as the predicate unregisters the native check.
+    void (*register_predicate)(lua_State *L, const char *name, ldk_checks_predicate predicate, void *ud);
+
+    // Checks the argument at position `arg` of the calling C function against a descriptor (see
+    // checks.check_type). The descriptor is compiled on first use and cached on its address, so
+    // it must be a string constant: a different string at the same address is not seen.
+    void (*checktype)(lua_State *L, int arg, const char *descriptor);
+
+    // Creates a signature from `n` descriptors (see checks.signature) and pushes it on the stack.
+    // The returned signature is valid as long as the pushed value is reachable.
+    const ldk_checks_signature *(*newsignature)(lua_State *L, int n, const char *const descriptors[]);
+
+    // Checks all the arguments of the calling C function against a signature.
+    void (*checktypes)(lua_State *L, const ldk_checks_signature *sig);
+} ldk_checks_api;
+
+// Returns the C interface of the library, or NULL if the library has not been loaded in the state.
+static inline const ldk_checks_api *ldk_checks_getapi(lua_State *L)
+{
+    lua_getfield(L, LUA_REGISTRYINDEX, LDK_CHECKS_API);
+    const ldk_checks_api *api = (const ldk_checks_api *)lua_touserdata(L, -1);
+    lua_pop(L, 1);
+    return api;
+}
+
+// Returns the C interface of the library; raises an error if the library has not been loaded in
+// the state, or is older than this header. The interface is looked up in the state on each call,
+// as a C module can be called from states that have not loaded the library.
+static inline const ldk_checks_api *ldk_checks_bind(lua_State *L)
+{
+    const ldk_checks_api *api = ldk_checks_getapi(L);
+    if (api == NULL || api->version < LDK_CHECKS_API_VERSION)
+    {
+        lua_pushstring(L, "ldk.checks is not loaded");
+        lua_error(L);
+    }
+    return api;
+}
+
+static inline void ldk_checktype(lua_State *L, int arg, const char *descriptor)
+{
+    ldk_checks_bind(L)->checktype(L, arg, descriptor);
+}
+
+static inline void ldk_checktypes(lua_State *L, const ldk_checks_signature *sig)
+{
+    ldk_checks_bind(L)->checktypes(L, sig);
+}
@@ -1,56 +1,103 @@
+#include "compat.h"
 #include "liberror.h"
 
 #include <lauxlib.h>
+#include <stdbool.h>
 #include <string.h>
 
-static int findfield(lua_State *L, int object_index, int level)
+// The names of the functions reachable from `package.loaded`, resolved on the error path when the
+// debug information has no name for the function that raised the error. A function is looked up by
+// walking `package.loaded` two levels deep until it is found; its name, or false if it is not
+// found, is then cached in a weak-keyed table, so the walk is done once per function until the
+// table is dropped by errorL_forgetnames.
+static const char funcnames_key = 'f';
+
+// pushes the name under which a walk of `package.loaded` two levels deep first finds the function
+// at index `f`; returns false, pushing nothing, if the function is not found.
+static bool find_funcname(lua_State *L, int f)
 {
-    if (level == 0 || !lua_istable(L, -1)) return 0;
-    lua_pushnil(L);                                    // nil
-    while (lua_next(L, -2))                            // k, v
-    {                                                  //
-        if (lua_type(L, -2) == LUA_TSTRING)            //
-        {                                              //
-            if (lua_rawequal(L, object_index, -1))     //
-            {                                          //
-                lua_pop(L, 1);                         // k
-                return 1;                              //
-            }                                          //
-            if (findfield(L, object_index, level - 1)) // k v k
-            {                                          //
-                lua_pushliteral(L, ".");               // k v k "."
-                lua_replace(L, -3);                    // k "." k
-                lua_concat(L, 3);                      // "k.k"
-                return 1;                              //
-            }                                          //
-        }                                              //
-        lua_pop(L, 1);                                 // k
-    }
-    return 0;
+    int top = lua_gettop(L);
+    lua_getfield(L, LUA_REGISTRYINDEX, LUA_LOADED_TABLE);    // loaded
+    for (lua_pushnil(L); lua_next(L, top + 1); lua_pop(L, 1)) // loaded module v
+    {
+        if (lua_type(L, -2) != LUA_TSTRING) continue;
+        if (lua_rawequal(L, -1, f))
+        {
+            lua_pushvalue(L, -2); // loaded module v name
+            lua_replace(L, top + 1);
+            lua_settop(L, top + 1); // name
+            return true;
+        }
+        if (!lua_istable(L, -1)) continue;
+
+        for (lua_pushnil(L); lua_next(L, -2); lua_pop(L, 1)) // loaded module v field fv
+        {
+            if (lua_type(L, -2) != LUA_TSTRING || !lua_rawequal(L, -1, f)) continue;
+            if (strcmp(lua_tostring(L, -4), "_G") == 0)
+            {
+                lua_pushvalue(L, -2); // loaded module v field fv name
+            }
+            else
+            {
+                lua_pushfstring(L, "%s.%s", lua_tostring(L, -4), lua_tostring(L, -2)); // loaded module v field fv name
+            }
+            lua_replace(L, top + 1);
+            lua_settop(L, top + 1); // name
+            return true;
+        }
+    }
+    lua_settop(L, top);
+    return false;
 }
 
-static int pushglobalfuncname(lua_State *L, lua_Debug *ar)
+// pushes the name of the function at index `f` found in `package.loaded`; returns false, pushing
+// nothing, if the function is not found.
+static bool push_funcname(lua_State *L, int f)
 {
-    int top = lua_gettop(L);
+    f = lua_absindex(L, f);
+    if (lua_rawgetp(L, LUA_REGISTRYINDEX, &funcnames_key) != LUA_TTABLE) // names
+    {
+        lua_pop(L, 1);
+        lua_newtable(L);               // names
+        lua_newtable(L);               // names mt
+        lua_pushliteral(L, "k");       // names mt "k"
+        lua_setfield(L, -2, "__mode"); // names mt
+        lua_setmetatable(L, -2);       // names
+        lua_pushvalue(L, -1);          // names names
+        lua_rawsetp(L, LUA_REGISTRYINDEX, &funcnames_key);
+    }
 
-    lua_getinfo(L, "f", ar);                              // f
-    lua_getfield(L, LUA_REGISTRYINDEX, LUA_LOADED_TABLE); // f LUA_LOADED_TABLE
-                                                          //
-    if (findfield(L, top + 1, 2))                         // f LUA_LOADED_TABLE name
-    {                                                     //
-        const char *name = lua_tostring(L, -1);           // f LUA_LOADED_TABLE name
-        if (strncmp(name, "_G.", 3) == 0)                 //
-        {                                                 //
-            lua_pushstring(L, name + 3);                  // f LUA_LOADED_TABLE name name + 3
-            lua_remove(L, -2);                            // f LUA_LOADED_TABLE name + 3
-        }                                                 //
-        lua_copy(L, -1, top + 1);                         // name f LUA_LOADED_TABLE
-        lua_settop(L, top + 1);                           // name
-        return 1;
+    lua_pushvalue(L, f); // names f
+    switch (lua_rawget(L, -2)) // names name
+    {
+        case LUA_TSTRING:
+            lua_remove(L, -2); // name
+            return true;
+        case LUA_TBOOLEAN:
+            lua_pop(L, 2);
+            return false;
     }
+    lua_pop(L, 1); // names
 
-    lua_settop(L, top);
-    return 0;
+    if (!find_funcname(L, f)) // names name
+    {
+        lua_pushvalue(L, f);   // names f
+        lua_pushboolean(L, 0); // names f false
+        lua_rawset(L, -3);     // names
+        lua_pop(L, 1);
+        return false;
+    }
+    lua_pushvalue(L, f);  // names name f
+    lua_pushvalue(L, -2); // names name f name
+    lua_rawset(L, -4);    // names name
+    lua_remove(L, -2);    // name
+    return true;
+}
+
+void errorL_forgetnames(lua_State *L)
+{
+    lua_pushnil(L);
+    lua_rawsetp(L, LUA_REGISTRYINDEX, &funcnames_key);
 }
 
 int errorL_errorf(lua_State *L, int level, const char *fmt, ...)
@@ -64,23 +111,107 @@ int errorL_errorf(lua_State *L, int level, const char *fmt, ...)
     return lua_error(L);
 }
 
-int errorL_argerror(lua_State *L, int level, int arg, const char *extramsg)
+void errorL_getsite(lua_State *L, int level, int arg, errorL_site *site)
 {
+    site->arg = arg;
+    site->line = -1;
+    site->has_name = false;
+    site->is_method = false;
+
     lua_Debug ar;
+    if (lua_getstack(L, level + 1, &ar))
+    {
+        lua_getinfo(L, "Sl", &ar);
+        if (ar.currentline > 0)
+        {
+            site->line = ar.currentline;
+            memcpy(site->source, ar.short_src, sizeof(site->source));
+        }
+    }
+
     if (!lua_getstack(L, level, &ar))
     {
-        return errorL_errorf(L, level, "bad argument #%d (%s)", arg, extramsg);
+        lua_pushnil(L);
+        return;
     }
+    site->has_name = true;
     lua_getinfo(L, "n", &ar);
-    if (strcmp(ar.namewhat, "method") == 0 && --arg == 0)
+    if (strcmp(ar.namewhat, "method") == 0 && --site->arg == 0)
+    {
+        site->is_method = true;
+    }
+    if (ar.name != NULL)
     {
-        return extramsg ? errorL_errorf(L, level, "calling '%s' on bad self (%s)", ar.name, extramsg)
-                        : errorL_errorf(L, level, "calling '%s' on bad self", ar.name);
+        lua_pushstring(L, ar.name);
     }
-    if (ar.name == NULL)
+    else
     {
-        ar.name = pushglobalfuncname(L, &ar) ? lua_tostring(L, -1) : "?";
+        lua_getinfo(L, "f", &ar); // the name is looked up by errorL_pushname
     }
-    return extramsg ? errorL_errorf(L, level, "bad argument #%d to '%s' (%s)", arg, ar.name, extramsg)
-                    : errorL_errorf(L, level, "bad argument #%d to '%s'", arg, ar.name);
+}
+
+void errorL_pushname(lua_State *L, int idx)
+{
+    switch (lua_type(L, idx))
+    {
+        case LUA_TSTRING:
+            lua_pushvalue(L, idx);
+            return;
+        case LUA_TFUNCTION:
+            if (push_funcname(L, idx)) return;
+            break;
+    }
+    lua_pushliteral(L, "?");
+}
+
+void errorL_pushsite(lua_State *L, const errorL_site *site, int name, const char *extramsg)
+{
+    name = lua_absindex(L, name);
+    if (site->line > 0)
+    {
+        lua_pushfstring(L, "%s:%d: ", site->source, site->line);
+    }
+    else
+    {
+        lua_pushliteral(L, "");
+    }
+
+    if (!site->has_name)
+    {
+        lua_pushfstring(L, "bad argument #%d (%s)", site->arg, extramsg);
+        lua_concat(L, 2);
+        return;
+    }
+
+    errorL_pushname(L, name); // where name
+    const char *function = lua_tostring(L, -1);
+    if (site->is_method)
+    {
+        if (extramsg)
+        {
+            lua_pushfstring(L, "calling '%s' on bad self (%s)", function, extramsg);
+        }
+        else
+        {
+            lua_pushfstring(L, "calling '%s' on bad self", function);
+        }
+    }
+    else if (extramsg)
+    {
+        lua_pushfstring(L, "bad argument #%d to '%s' (%s)", site->arg, function, extramsg);
+    }
+    else
+    {
+        lua_pushfstring(L, "bad argument #%d to '%s'", site->arg, function);
+    }
+    lua_remove(L, -2); // where message
+    lua_concat(L, 2);
+}
+
+int errorL_argerror(lua_State *L, int level, int arg, const char *extramsg)
+{
+    errorL_site site;
+    errorL_getsite(L, level, arg, &site); // name
+    errorL_pushsite(L, &site, -1, extramsg);
+    return lua_error(L);
 }
@@ -1,6 +1,36 @@
 #pragma once
 
 #include <lua.h>
+#include <stdbool.h>
+
+// The site of an argument error: the blamed function and the location of its caller, captured when
+// the error is detected so that the message can be formatted later. The name of the blamed
+// function is kept on the Lua stack (see errorL_getsite).
+typedef struct
+{
+    int arg;                 // position of the bad argument
+    int line;                // current line of the caller, or -1 if unknown
+    bool has_name;           // false if there is no function at the blamed level
+    bool is_method;          // true if the bad argument is the receiver of a method call
+    char source[LUA_IDSIZE]; // short source of the caller
+} errorL_site;
 
 int errorL_errorf(lua_State *L, int level, const char *fmt, ...);
 int errorL_argerror(lua_State *L, int level, int arg, const char *extramsg);
+
+// Captures the site of an argument error and pushes the name of the blamed function: a string, the
+// function itself if its name is to be looked up in the loaded modules, or nil if there is no
+// function at `level`.
+void errorL_getsite(lua_State *L, int level, int arg, errorL_site *site);
+
+// Pushes the name of a blamed function from the value at index `idx` pushed by errorL_getsite:
+// the name itself, the name under which the function is loaded, or "?".
+void errorL_pushname(lua_State *L, int idx);
+
+// Forgets the names of the functions found in the loaded modules, and the functions not found
+// there, after the modules have changed.
+void errorL_forgetnames(lua_State *L);
+
+// Pushes the message of an argument error; `name` is the index of the value pushed by
+// errorL_getsite.
+void errorL_pushsite(lua_State *L, const errorL_site *site, int name, const char *extramsg);
@@ -0,0 +1,387 @@
+#include "libtext.h"
+
+#include <stdint.h>
+#include <string.h>
+
+// The vector kernels need the `target` attribute and `__builtin_cpu_supports`; elsewhere only the
+// scalar kernels are built.
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define TEXTL_X86 1
+#include <immintrin.h>
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TEXTL_X86 0
+#endif
+
+// -1 if the instruction set is detected on each call.
+static int selected_isa = -1;
+
+static textL_isa detect_isa(void)
+{
+#if TEXTL_X86
+    // SSE2 is part of x86-64
+    return __builtin_cpu_supports("avx2") ? TEXTL_AVX2 : TEXTL_SSE2;
+#else
+    return TEXTL_SCALAR;
+#endif
+}
+
+textL_isa textL_getisa(void)
+{
+    return selected_isa < 0 ? detect_isa() : (textL_isa)selected_isa;
+}
+
+textL_isa textL_setisa(textL_isa isa)
+{
+    textL_isa best = detect_isa();
+    selected_isa = isa > best ? best : isa;
+    return (textL_isa)selected_isa;
+}
+
+static inline bool is_control(unsigned char c)
+{
+    return (c < 0x20 && c != '\t' && c != '\n' && c != '\r') || c == 0x7F;
+}
+
+// returns the length of the valid UTF-8 sequence starting at `p`, or 0 if the sequence is invalid.
+static inline size_t utf8_sequence(const unsigned char *p, const unsigned char *e)
+{
+    unsigned c = p[0];
+    if (c < 0x80) return 1;
+    if (c < 0xC2) return 0; // a continuation byte, or the lead byte of an overlong encoding
+    if (c < 0xE0) return e - p >= 2 && (p[1] & 0xC0) == 0x80 ? 2 : 0;
+    if (c < 0xF0)
+    {
+        // no overlong encodings, no surrogates
+        unsigned lo = c == 0xE0 ? 0xA0 : 0x80;
+        unsigned hi = c == 0xED ? 0x9F : 0xBF;
+        return e - p >= 3 && p[1] >= lo && p[1] <= hi && (p[2] & 0xC0) == 0x80 ? 3 : 0;
+    }
+    if (c < 0xF5)
+    {
+        // no overlong encodings, nothing past U+10FFFF
+        unsigned lo = c == 0xF0 ? 0x90 : 0x80;
+        unsigned hi = c == 0xF4 ? 0x8F : 0xBF;
+        return e - p >= 4 && p[1] >= lo && p[1] <= hi && (p[2] & 0xC0) == 0x80 && (p[3] & 0xC0) == 0x80 ? 4 : 0;
+    }
+    return 0;
+}
+
+// Scalar kernels.
+
+static bool ascii_scalar(const unsigned char *s, size_t len)
+{
+    uint64_t bits = 0;
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8)
+    {
+        uint64_t word;
+        memcpy(&word, s + i, sizeof(word));
+        bits |= word;
+    }
+    for (; i < len; i++) bits |= s[i];
+    return (bits & UINT64_C(0x8080808080808080)) == 0;
+}
+
+static bool utf8_scalar(const unsigned char *s, size_t len)
+{
+    const unsigned char *e = s + len;
+    for (const unsigned char *p = s; p < e;)
+    {
+        uint64_t word;
+        if (e - p >= 8 && (memcpy(&word, p, sizeof(word)), (word & UINT64_C(0x8080808080808080)) == 0))
+        {
+            p += 8;
+            continue;
+        }
+        size_t n = utf8_sequence(p, e);
+        if (n == 0) return false;
+        p += n;
+    }
+    return true;
+}
+
+static bool controls_scalar(const unsigned char *s, size_t len)
+{
+    for (size_t i = 0; i < len; i++)
+    {
+        if (is_control(s[i])) return true;
+    }
+    return false;
+}
+
+#if TEXTL_X86
+
+// SSE2 kernels. Without byte shuffles, UTF-8 is validated by skipping runs of 16 ASCII bytes and
+// decoding the other sequences one by one.
+
+static bool ascii_sse2(const unsigned char *s, size_t len)
+{
+    size_t i = 0;
+    for (; i + 64 <= len; i += 64)
+    {
+        __m128i a = _mm_loadu_si128((const __m128i *)(s + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(s + i + 16));
+        __m128i c = _mm_loadu_si128((const __m128i *)(s + i + 32));
+        __m128i d = _mm_loadu_si128((const __m128i *)(s + i + 48));
+        if (_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(c, d))) != 0) return false;
+    }
+    for (; i + 16 <= len; i += 16)
+    {
+        if (_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)(s + i))) != 0) return false;
+    }
+    return ascii_scalar(s + i, len - i);
+}
+
+static bool utf8_sse2(const unsigned char *s, size_t len)
+{
+    const unsigned char *p = s;
+    const unsigned char *e = s + len;
+    while (p < e)
+    {
+        if (e - p >= 16 && _mm_movemask_epi8(_mm_loadu_si128((const __m128i *)p)) == 0)
+        {
+            p += 16;
+            continue;
+        }
+        // the sequences starting in the next 16 bytes
+        const unsigned char *stop = e - p > 16 ? p + 16 : e;
+        while (p < stop)
+        {
+            size_t n = utf8_sequence(p, e);
+            if (n == 0) return false;
+            p += n;
+        }
+    }
+    return true;
+}
+
+static bool controls_sse2(const unsigned char *s, size_t len)
+{
+    const __m128i max_control = _mm_set1_epi8(0x1F);
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i lf = _mm_set1_epi8('\n');
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i del = _mm_set1_epi8(0x7F);
+
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16)
+    {
+        __m128i x = _mm_loadu_si128((const __m128i *)(s + i));
+        __m128i low = _mm_cmpeq_epi8(_mm_min_epu8(x, max_control), x);
+        __m128i space = _mm_or_si128(_mm_cmpeq_epi8(x, tab), _mm_or_si128(_mm_cmpeq_epi8(x, lf), _mm_cmpeq_epi8(x, cr)));
+        __m128i bad = _mm_or_si128(_mm_andnot_si128(space, low), _mm_cmpeq_epi8(x, del));
+        if (_mm_movemask_epi8(bad) != 0) return true;
+    }
+    return controls_scalar(s + i, len - i);
+}
+
+// AVX2 kernels. UTF-8 is validated 32 bytes at a time with the lookup algorithm of Keiser and
+// Lemire ("Validating UTF-8 in less than one instruction per byte", 2021): three table lookups on
+// the nibbles of each pair of adjacent bytes classify the errors of two-byte sequences, and the
+// positions of the third and fourth bytes of longer sequences are checked with saturated
+// subtractions.
+
+#define TOO_SHORT (1 << 0)      // a lead byte or ASCII followed by a lead byte or ASCII
+#define TOO_LONG (1 << 1)       // ASCII followed by a continuation byte
+#define OVERLONG_3 (1 << 2)     // 11100000 100_____
+#define TOO_LARGE (1 << 3)      // 11110100 1001____, or a larger lead byte followed by 1001____ or 101_____
+#define SURROGATE (1 << 4)      // 11101101 101_____
+#define OVERLONG_2 (1 << 5)     // 1100000_ 10______
+#define TOO_LARGE_1000 (1 << 6) // a lead byte larger than 11110100 followed by 1000____
+#define OVERLONG_4 (1 << 6)     // 11110000 1000____
+#define TWO_CONTS (1 << 7)      // a continuation byte followed by a continuation byte
+#define CARRY (TOO_SHORT | TOO_LONG | TWO_CONTS)
+
+// repeats a 16-byte table in both lanes, for _mm256_shuffle_epi8; the entries are bit sets that
+// can have the high bit set, hence the casts.
+#define LANE(a, b, c, d, e, f, g, h, i, j, k, l, m, n, o, p)                                                    \
+    (char)(a), (char)(b), (char)(c), (char)(d), (char)(e), (char)(f), (char)(g), (char)(h), (char)(i), (char)(j), \
+        (char)(k), (char)(l), (char)(m), (char)(n), (char)(o), (char)(p)
+#define LANES(a, b, c, d, e, f, g, h, i, j, k, l, m, n, o, p) \
+    _mm256_setr_epi8(LANE(a, b, c, d, e, f, g, h, i, j, k, l, m, n, o, p), LANE(a, b, c, d, e, f, g, h, i, j, k, l, m, n, o, p))
+
+TARGET_AVX2 static bool ascii_avx2(const unsigned char *s, size_t len)
+{
+    size_t i = 0;
+    for (; i + 128 <= len; i += 128)
+    {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(s + i));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(s + i + 32));
+        __m256i c = _mm256_loadu_si256((const __m256i *)(s + i + 64));
+        __m256i d = _mm256_loadu_si256((const __m256i *)(s + i + 96));
+        if (_mm256_movemask_epi8(_mm256_or_si256(_mm256_or_si256(a, b), _mm256_or_si256(c, d))) != 0) return false;
+    }
+    for (; i + 32 <= len; i += 32)
+    {
+        if (_mm256_movemask_epi8(_mm256_loadu_si256((const __m256i *)(s + i))) != 0) return false;
+    }
+    return ascii_scalar(s + i, len - i);
+}
+
+// the bytes of `x` shifted by `n` positions, with the last `n` bytes of `prev` shifted in.
+#define PREV(x, prev, n) _mm256_alignr_epi8(x, _mm256_permute2x128_si256(prev, x, 0x21), 16 - (n))
+
+typedef struct
+{
+    __m256i prev;       // the previous block
+    __m256i incomplete; // non-zero if the previous block ends with an incomplete sequence
+    __m256i error;      // non-zero if an error has been found
+} utf8_state;
+
+TARGET_AVX2 static inline void utf8_block(utf8_state *st, __m256i x)
+{
+    if (_mm256_movemask_epi8(x) == 0)
+    {
+        st->error = _mm256_or_si256(st->error, st->incomplete);
+        st->incomplete = _mm256_setzero_si256();
+        st->prev = x;
+        return;
+    }
+
+    const __m256i nibble = _mm256_set1_epi8(0x0F);
+    const __m256i byte_1_high = LANES(TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+                                      TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS, //
+                                      TOO_SHORT | OVERLONG_2,                     //
+                                      TOO_SHORT,                                  //
+                                      TOO_SHORT | OVERLONG_3 | SURROGATE,         //
+                                      TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4);
+    const __m256i byte_1_low = LANES(CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4, //
+                                     CARRY | OVERLONG_2,                           //
+                                     CARRY, CARRY,                                 //
+                                     CARRY | TOO_LARGE,                            //
+                                     CARRY | TOO_LARGE | TOO_LARGE_1000,           //
+                                     CARRY | TOO_LARGE | TOO_LARGE_1000,           //
+                                     CARRY | TOO_LARGE | TOO_LARGE_1000,           //
+                                     CARRY | TOO_LARGE | TOO_LARGE_1000,           //
+                                     CARRY | TOO_LARGE | TOO_LARGE_1000,           //
+                                     CARRY | TOO_LARGE | TOO_LARGE_1000,           //
+                                     CARRY | TOO_LARGE | TOO_LARGE_1000,           //
+                                     CARRY | TOO_LARGE | TOO_LARGE_1000,           //
+                                     CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE,
+                                     CARRY | TOO_LARGE | TOO_LARGE_1000, //
+                                     CARRY | TOO_LARGE | TOO_LARGE_1000);
+    const __m256i byte_2_high = LANES(TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+                                      TOO_SHORT, //
+                                      TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4,
+                                      TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+                                      TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+                                      TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE, //
+                                      TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT);
+    // the bytes that would start a sequence not ending in the block
+    const __m256i max_complete = _mm256_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, //
+                                                  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,             //
+                                                  (char)(0xF0 - 1), (char)(0xE0 - 1), (char)(0xC0 - 1));
+
+    __m256i prev1 = PREV(x, st->prev, 1);
+    __m256i prev1_high = _mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibble);
+    __m256i prev1_low = _mm256_and_si256(prev1, nibble);
+    __m256i x_high = _mm256_and_si256(_mm256_srli_epi16(x, 4), nibble);
+    __m256i special = _mm256_and_si256(_mm256_and_si256(_mm256_shuffle_epi8(byte_1_high, prev1_high),
+                                                        _mm256_shuffle_epi8(byte_1_low, prev1_low)),
+                                       _mm256_shuffle_epi8(byte_2_high, x_high));
+
+    // the third and fourth bytes of a sequence must be continuation bytes, the only allowed pairs
+    // of continuation bytes
+    __m256i third = _mm256_subs_epu8(PREV(x, st->prev, 2), _mm256_set1_epi8((char)(0xE0 - 0x80)));
+    __m256i fourth = _mm256_subs_epu8(PREV(x, st->prev, 3), _mm256_set1_epi8((char)(0xF0 - 0x80)));
+    __m256i must_continue = _mm256_and_si256(_mm256_or_si256(third, fourth), _mm256_set1_epi8((char)0x80));
+
+    st->error = _mm256_or_si256(st->error, _mm256_xor_si256(must_continue, special));
+    st->incomplete = _mm256_subs_epu8(x, max_complete);
+    st->prev = x;
+}
+
+TARGET_AVX2 static bool utf8_avx2(const unsigned char *s, size_t len)
+{
+    utf8_state st;
+    st.prev = _mm256_setzero_si256();
+    st.incomplete = _mm256_setzero_si256();
+    st.error = _mm256_setzero_si256();
+
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32)
+    {
+        utf8_block(&st, _mm256_loadu_si256((const __m256i *)(s + i)));
+    }
+    if (i < len)
+    {
+        // the last bytes, padded with ASCII
+        unsigned char tail[32] = {0};
+        memcpy(tail, s + i, len - i);
+        utf8_block(&st, _mm256_loadu_si256((const __m256i *)tail));
+    }
+    st.error = _mm256_or_si256(st.error, st.incomplete);
+    return _mm256_testz_si256(st.error, st.error);
+}
+
+TARGET_AVX2 static bool controls_avx2(const unsigned char *s, size_t len)
+{
+    const __m256i max_control = _mm256_set1_epi8(0x1F);
+    const __m256i tab = _mm256_set1_epi8('\t');
+    const __m256i lf = _mm256_set1_epi8('\n');
+    const __m256i cr = _mm256_set1_epi8('\r');
+    const __m256i del = _mm256_set1_epi8(0x7F);
+
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32)
+    {
+        __m256i x = _mm256_loadu_si256((const __m256i *)(s + i));
+        __m256i low = _mm256_cmpeq_epi8(_mm256_min_epu8(x, max_control), x);
+        __m256i space = _mm256_or_si256(_mm256_cmpeq_epi8(x, tab),
+                                        _mm256_or_si256(_mm256_cmpeq_epi8(x, lf), _mm256_cmpeq_epi8(x, cr)));
+        __m256i bad = _mm256_or_si256(_mm256_andnot_si256(space, low), _mm256_cmpeq_epi8(x, del));
+        if (_mm256_movemask_epi8(bad) != 0) return true;
+    }
+    return controls_scalar(s + i, len - i);
+}
+
+#endif
+
+bool textL_isascii(const char *s, size_t len)
+{
+    const unsigned char *p = (const unsigned char *)s;
+    switch (textL_getisa())
+    {
+#if TEXTL_X86
+        case TEXTL_AVX2:
+            return ascii_avx2(p, len);
+        case TEXTL_SSE2:
+            return ascii_sse2(p, len);
+#endif
+        default:
+            return ascii_scalar(p, len);
+    }
+}
+
+bool textL_isutf8(const char *s, size_t len)
+{
+    const unsigned char *p = (const unsigned char *)s;
+    switch (textL_getisa())
+    {
+#if TEXTL_X86
+        case TEXTL_AVX2:
+            return utf8_avx2(p, len);
+        case TEXTL_SSE2:
+            return utf8_sse2(p, len);
+#endif
+        default:
+            return utf8_scalar(p, len);
+    }
+}
+
+bool textL_isprintable(const char *s, size_t len)
+{
+    const unsigned char *p = (const unsigned char *)s;
+    switch (textL_getisa())
+    {
+#if TEXTL_X86
+        case TEXTL_AVX2:
+            return !controls_avx2(p, len) && utf8_avx2(p, len);
+        case TEXTL_SSE2:
+            return !controls_sse2(p, len) && utf8_sse2(p, len);
+#endif
+        default:
+            return !controls_scalar(p, len) && utf8_scalar(p, len);
+    }
+}
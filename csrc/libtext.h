@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// The instruction sets of the validation kernels; the kernels of every instruction set return the
+// same results.
+typedef enum
+{
+    TEXTL_SCALAR,
+    TEXTL_SSE2,
+    TEXTL_AVX2,
+} textL_isa;
+
+// Whether a string is made only of ASCII characters.
+bool textL_isascii(const char *s, size_t len);
+
+// Whether a string is valid UTF-8: no overlong encodings, surrogates or code points past U+10FFFF.
+bool textL_isutf8(const char *s, size_t len);
+
+// Whether a string is valid UTF-8 without ASCII control characters other than tab, line feed and
+// carriage return.
+bool textL_isprintable(const char *s, size_t len);
+
+// Returns the instruction set of the kernels: the best one supported by the CPU, unless another
+// one has been selected with textL_setisa.
+textL_isa textL_getisa(void);
+
+// Selects the instruction set of the kernels, for tests and benchmarks; returns the selected one,
+// which is `isa` if the CPU supports it and the best supported one otherwise. Not thread-safe.
+textL_isa textL_setisa(textL_isa isa);
@@ -0,0 +1,154 @@
+// Calls the C interface of ldk_checks.h from C functions, and verifies that it accepts and rejects
+// the same arguments as the Lua functions of the library, with the same messages.
+
+#include "ldk_checks.h"
+
+#include <lauxlib.h>
+#include <lualib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+extern int luaopen_ldk_checks(lua_State *L);
+
+// more than the descriptors of the C interface that are cached
+#define DESCRIPTOR_COPIES 1500
+
+static char copies[DESCRIPTOR_COPIES][sizeof("?integer")];
+
+static const char script[] = //
+    "local checks = ...\n"
+    "local function fails(message, f, ...)\n"
+    "  local ok, err = pcall(f, ...)\n"
+    "  if ok then error('accepted the arguments of: ' .. message, 2) end\n"
+    "  if not tostring(err):find(message, 1, true) then error(('%s instead of %s'):format(err, message), 2) end\n"
+    "end\n"
+    "one(1)\n"
+    "one(1, 'x')\n"
+    "fails('(integer expected, got string)', one, 'x')\n"
+    "fails('(integer expected, got no value)', one)\n"
+    "fails('bad argument #2', one, 1, 2)\n"
+    "even(2)\n"
+    "fails('(even expected, got number)', even, 3)\n"
+    "two('x', 1)\n"
+    "fails('(integer expected, got no value)', two, 'x')\n"
+    "fails('(string expected, got number)', two, 1, 1)\n"
+    "if copies(1) ~= 1 then error('unbalanced stack') end\n"
+    "copies(nil)\n"
+    "fails('(integer expected, got string)', copies, 'x')\n"
+    "checks.set_level('off')\n"
+    "one('x')\n"
+    "checks.set_level('full')\n";
+
+static const ldk_checks_signature *two_signature;
+
+// the interface looked up in the state that loaded the library
+static const ldk_checks_api *loaded_api;
+
+static bool is_even(lua_State *L, int idx, void *ud)
+{
+    (void)ud;
+    return lua_isinteger(L, idx) && lua_tointeger(L, idx) % 2 == 0;
+}
+
+static int one(lua_State *L)
+{
+    ldk_checktype(L, 1, "integer");
+    ldk_checktype(L, 2, "?string");
+    return 0;
+}
+
+static int even(lua_State *L)
+{
+    ldk_checktype(L, 1, "even");
+    return 0;
+}
+
+static int two(lua_State *L)
+{
+    ldk_checktypes(L, two_signature);
+    return 0;
+}
+
+// checks its argument against every copy of the same descriptor, each at its own address
+static int check_copies(lua_State *L)
+{
+    for (int i = 0; i < DESCRIPTOR_COPIES; i++)
+    {
+        ldk_checktype(L, 1, copies[i]);
+    }
+    lua_pushinteger(L, lua_gettop(L));
+    return 1;
+}
+
+// checks its argument through the interface of another state
+static int foreign(lua_State *L)
+{
+    loaded_api->checktype(L, 1, "integer");
+    return 0;
+}
+
+// runs `f` in a state that has not loaded the library, and returns whether it raised the error of
+// an unloaded library.
+static bool fails_unloaded(lua_CFunction f)
+{
+    lua_State *L = luaL_newstate();
+    lua_pushcfunction(L, f);
+    lua_pushinteger(L, 1);
+    bool unloaded = lua_pcall(L, 1, 0, 0) != LUA_OK && strcmp(lua_tostring(L, -1), "ldk.checks is not loaded") == 0;
+    lua_close(L);
+    return unloaded;
+}
+
+static int fail(const char *what, const char *message)
+{
+    fprintf(stderr, "%s: %s\n", what, message);
+    return EXIT_FAILURE;
+}
+
+int main(void)
+{
+    for (int i = 0; i < DESCRIPTOR_COPIES; i++)
+    {
+        snprintf(copies[i], sizeof(copies[i]), "?integer");
+    }
+
+    // without the library, the checks raise an error
+    if (!fails_unloaded(one)) return fail("unloaded library", "no error");
+
+    lua_State *L = luaL_newstate();
+    luaL_openlibs(L);
+    luaL_requiref(L, "ldk.checks", luaopen_ldk_checks, 0); // checks
+
+    const ldk_checks_api *api = ldk_checks_getapi(L);
+    if (api == NULL) return fail("getapi", "no interface");
+    loaded_api = api;
+    api->register_predicate(L, "even", is_even, NULL);
+
+    static const char *const descriptors[] = {"string", "integer"};
+    two_signature = api->newsignature(L, 2, descriptors); // checks sig
+    lua_setfield(L, LUA_REGISTRYINDEX, "capi.signature"); // checks
+
+    lua_register(L, "one", one);
+    lua_register(L, "even", even);
+    lua_register(L, "two", two);
+    lua_register(L, "copies", check_copies);
+
+    if (luaL_loadbuffer(L, script, sizeof(script) - 1, "=capi") != LUA_OK)
+    {
+        return fail("load", lua_tostring(L, -1));
+    }
+    lua_insert(L, -2); // script checks
+    if (lua_pcall(L, 1, 0, 0) != LUA_OK)
+    {
+        return fail("run", lua_tostring(L, -1));
+    }
+
+    // once the library is loaded in a state, the other states still lack it
+    if (!fails_unloaded(one)) return fail("second state", "no error");
+    if (!fails_unloaded(foreign)) return fail("interface of another state", "no error");
+    lua_close(L);
+
+    printf("ok\n");
+    return EXIT_SUCCESS;
+}
@@ -40,6 +40,43 @@ describe("#checks", function()
         assert.error(function() global_fn(1) end, "bad argument #1 to 'global_fn'")
         assert.error(function() local_fn(1) end, "bad argument #1 to 'local_fn'")
       end)
+      it("names functions of loaded modules", function()
+        local module = {fn = function(arg) checks.arg_error(arg) end}
+        local _, err = pcall(module.fn, 1)
+        assert.matches("bad argument #1 to '?'", err, 1, true)
+        package.loaded['spec.module'] = module
+        checks.invalidate()
+        _, err = pcall(module.fn, 1)
+        package.loaded['spec.module'] = nil
+        assert.matches("bad argument #1 to 'spec.module.fn'", err, 1, true)
+      end)
+      it("names functions added to loaded modules", function()
+        local module = {fn = function(arg) checks.arg_error(arg) end}
+        package.loaded['spec.module'] = module
+        local _, err = pcall(module.fn, 1)
+        assert.matches("bad argument #1 to 'spec.module.fn'", err, 1, true)
+        module.other = function(arg) checks.arg_error(arg) end
+        _, err = pcall(module.other, 1)
+        package.loaded['spec.module'] = nil
+        assert.matches("bad argument #1 to 'spec.module.other'", err, 1, true)
+      end)
+      it("names functions again once invalidated", function()
+        local fn = function(arg) checks.arg_error(arg) end
+        local _, err = pcall(fn, 1)
+        assert.matches("bad argument #1 to '?'", err, 1, true)
+        package.loaded['spec.module'] = {fn = fn}
+        _, err = pcall(fn, 1)
+        assert.matches("bad argument #1 to '?'", err, 1, true)
+        checks.invalidate()
+        _, err = pcall(fn, 1)
+        assert.matches("bad argument #1 to 'spec.module.fn'", err, 1, true)
+        package.loaded['spec.module'] = nil
+        package.loaded['spec.renamed'] = {fn = fn}
+        checks.invalidate()
+        _, err = pcall(fn, 1)
+        package.loaded['spec.renamed'] = nil
+        assert.matches("bad argument #1 to 'spec.renamed.fn'", err, 1, true)
+      end)
       it("raises an argument error", function()
         assert.error(arg_error(1), "bad argument #1 to '?'")
         assert.error(arg_error(1, "message"), "bad argument #1 to '?' (message)")
@@ -124,6 +161,660 @@ describe("#checks", function()
         checks.register("object", nil)
         assert.error(function() f5({}) end)
       end)
+      it("should not replace the native checks", function()
+        for _, name in ipairs({'array', 'callable', 'nonempty', 'positive', 'ascii', 'utf8', 'printable'}) do
+          assert.error(function() checks.register(name, function() return true end) end,
+            "bad argument #1 to 'register' (name taken by a native check)")
+        end
+        assert.is_false(checks.is({x = 1}, 'array'))
+      end)
+    end)
+  end)
+  describe("set_level", function()
+    local function f(x) checks.check_type(1, 'integer|foo') return x end
+    local function g(x) checks.check_option(1, 'one|two') return x end
+    local function h(x) checks.check_types('table') return x end
+    local w = checks.wrap(checks.signature('string'), function(x) return x end)
+    after_each(function()
+      checks.set_level('full')
+      checks.set_level(nil, 'spec.mod')
+    end)
+    it("diagnoses bad levels", function()
+      assert.error(function() checks.set_level('none') end, "bad argument #1 to 'set_level' (invalid option 'none')")
+      assert.error(function() checks.set_level() end, "bad argument #1 to 'set_level' (string expected, got no value)")
+    end)
+    it("disables the checks", function()
+      local check_type = checks.check_type
+      checks.set_level('off')
+      assert.not_error(function() f('x') end)
+      assert.not_error(function() g('three') end)
+      assert.not_error(function() h(1) end)
+      assert.not_error(function() w(1) end)
+      assert.not_error(function() checks.check_arg(1, false) end)
+      assert.not_equal(check_type, checks.check_type)
+      checks.set_level('full')
+      assert.equal(check_type, checks.check_type)
+      assert.error(function() f('x') end, "bad argument #1 to 'f' (integer or foo expected, got string)")
+    end)
+    it("performs only primitive checks", function()
+      checks.set_level('primitive')
+      assert.not_error(function() f({}) end)
+      assert.not_error(function() g('three') end)
+      assert.error(function() f(nil) end, "bad argument #1 to 'f' (integer or foo expected, got nil)")
+      assert.error(function() g(1) end, "bad argument #1 to 'g' (string expected, got number)")
+      assert.error(function() h(1) end, "bad argument #1 to 'h' (table expected, got number)")
+      assert.error(function() w(1) end, "bad argument #1 to 'w' (string expected, got number)")
+    end)
+    it("sets the level of a module", function()
+      local code = [[
+        local checks = ...
+        return function(x) checks.check_type(1, 'integer') return x end
+      ]]
+      local m = load(code, '@spec/mod.lua')(checks)
+      checks.set_level('off', 'spec.mod')
+      assert.not_error(function() m('x') end)
+      assert.error(function() f('x') end, "bad argument #1 to 'f' (integer or foo expected, got string)")
+      checks.set_level(nil, 'spec.mod')
+      assert.error(function() m('x') end)
+    end)
+  end)
+  describe("set_error_mode", function()
+    local function f(x) checks.check_type(1, 'integer|foo') return x end
+    local function g(x) checks.check_option(1, 'one|two') return x end
+    local h = checks.wrap(checks.signature('string', 'table'), function() end)
+    after_each(function()
+      checks.set_error_mode('string')
+    end)
+    it("diagnoses bad modes", function()
+      assert.error(function() checks.set_error_mode('lazy') end, "bad argument #1 to 'set_error_mode' (invalid option 'lazy')")
+    end)
+    it("raises error objects", function()
+      checks.set_error_mode('object')
+      local _, err = pcall(function() f('x') end)
+      assert.equal('userdata', type(err))
+      assert.equal(1, err.arg)
+      assert.equal('integer|foo', err.expected)
+      assert.equal('string', err.got)
+      assert.equal('x', err.value)
+      assert.equal('f', err.name)
+      assert.equal('integer or foo expected, got string', err.message)
+      assert.matches("bad argument #1 to 'f' %(integer or foo expected, got string%)$", tostring(err))
+    end)
+    it("formats the messages of the string mode", function()
+      local cases = {
+        function() f('x') end,
+        function() g('three') end,
+        function() g(1) end,
+        function() h('x') end,
+      }
+      for _, case in ipairs(cases) do
+        local _, expected = pcall(case)
+        checks.set_error_mode('object')
+        local _, err = pcall(case)
+        checks.set_error_mode('string')
+        assert.equal(expected, tostring(err))
+      end
+    end)
+    it("reports missing arguments", function()
+      checks.set_error_mode('object')
+      local _, err = pcall(function() h('x') end)
+      assert.equal(2, err.arg)
+      assert.equal('no value', err.got)
+      assert.is_nil(err.value)
+    end)
+    it("keeps long function names", function()
+      local name = 'a_function_with_a_name_longer_than_the_sixty_characters_of_an_id'
+      local module = {[name] = function(_) checks.check_type(1, 'integer') end}
+      package.loaded['spec.module'] = module
+      local _, expected = pcall(module[name], 'x')
+      checks.set_error_mode('object')
+      local _, err = pcall(module[name], 'x')
+      package.loaded['spec.module'] = nil
+      assert.matches("bad argument #1 to 'spec.module." .. name .. "'", expected, 1, true)
+      assert.equal(expected, tostring(err))
+      assert.equal('spec.module.' .. name, err.name)
+    end)
+    it("keeps the descriptors that are not cached", function()
+      local function k(x, options) checks.check_option(1, options) return x end
+      for i = 1, 1100 do k('a', 'a|uncached' .. i) end
+      checks.set_error_mode('object')
+      local _, err = pcall(k, 'b', 'a|uncached_option')
+      checks.set_error_mode('string')
+      collectgarbage()
+      collectgarbage()
+      assert.equal(":a|uncached_option", err.expected)
+      assert.matches("bad argument #1 to 'k' %('a' or 'uncached_option' expected, got 'b'%)$", tostring(err))
+    end)
+  end)
+  describe("set_sampling", function()
+    local function f(_) checks.check_type(1, 'integer') end
+    local function g(_) checks.check_option(1, 'one|two') end
+    local function h(_) checks.check_types('Point') end
+    local function failures(fn, x, n)
+      local count = 0
+      for _ = 1, n do
+        if not pcall(fn, x) then count = count + 1 end
+      end
+      return count
+    end
+    after_each(function()
+      checks.set_sampling(1)
+      checks.set_sampling(nil, 'spec.mod')
+      checks.set_sampling(nil, f)
+      checks.always_check('Point', false)
+      checks.always_check(':one|two', false)
+    end)
+    it("diagnoses bad rates", function()
+      assert.error(function() checks.set_sampling(0) end, "bad argument #1 to 'set_sampling' (invalid sampling rate)")
+      assert.error(function() checks.set_sampling(1, true) end,
+        "bad argument #2 to 'set_sampling' (string or function expected, got boolean)")
+    end)
+    it("checks one call in n per call site", function()
+      checks.set_sampling(4)
+      assert.equal(3, failures(f, 'x', 12))
+      assert.equal(3, failures(g, 'three', 12))
+      assert.equal(3, failures(h, {}, 12))
+    end)
+    it("sets the rate of a function", function()
+      checks.set_sampling(4)
+      checks.set_sampling(1, f)
+      assert.equal(12, failures(f, 'x', 12))
+      assert.equal(3, failures(g, 'three', 12))
+    end)
+    it("sets the rate of a module", function()
+      local code = [[
+        local checks = ...
+        return function(x) checks.check_type(1, 'integer') return x end
+      ]]
+      local m = load(code, '@spec/mod.lua')(checks)
+      checks.set_sampling(2, 'spec.mod')
+      assert.equal(6, failures(m, 'x', 12))
+      assert.equal(12, failures(f, 'x', 12))
+    end)
+    it("never samples out forced descriptors", function()
+      checks.set_sampling(4)
+      checks.always_check('Point')
+      assert.equal(12, failures(h, {}, 12))
+    end)
+    it("never samples out forced options", function()
+      checks.set_sampling(4)
+      checks.always_check(':one|two')
+      assert.equal(12, failures(g, 'three', 12))
+    end)
+    it("samples each argument on its own", function()
+      local function k(_, _)
+        checks.check_type(1, 'number')
+        checks.check_type(2, 'number')
+      end
+      checks.set_sampling(2)
+      assert.equal(6, failures(function(x) k(x, 1) end, 'x', 12))
+      assert.equal(6, failures(function(x) k(1, x) end, 'x', 12))
+    end)
+  end)
+  describe("stats", function()
+    local function f(_) checks.check_type(1, 'integer') end
+    local function g(_) checks.check_type(1, 'even') end
+    before_each(function()
+      checks.reset_stats()
+    end)
+    after_each(function()
+      checks.set_stats('off')
+      checks.register('even', nil)
+    end)
+    it("diagnoses bad modes", function()
+      assert.error(function() checks.set_stats('maybe') end, "bad argument #1 to 'set_stats' (invalid option 'maybe')")
+    end)
+    it("counts nothing when off", function()
+      f(1)
+      local stats = checks.stats()
+      assert.equal(0, stats.functions.check_type.calls)
+      for _, site in pairs(stats.sites) do assert.equal(0, site.calls) end
+    end)
+    it("counts calls and failures", function()
+      checks.set_stats('on')
+      f(1)
+      f(2)
+      pcall(f, 'x')
+      local stats = checks.stats()
+      assert.same({calls = 3, failures = 1}, stats.functions.check_type)
+      local _, site = next(stats.sites)
+      assert.same({calls = 3, failures = 1, slow = 0, checkers = 0}, site)
+      assert.is_nil(stats.clock)
+    end)
+    it("counts the registered checks per descriptor", function()
+      checks.set_stats('on')
+      checks.register('even', function(x) return x % 2 == 0 end)
+      g(2)
+      pcall(g, 3)
+      assert.same({slow = 2, checkers = 2}, checks.stats().descriptors.even)
+    end)
+    it("counts the registered checks per call site", function()
+      checks.set_stats('on')
+      checks.register('even', function(x) return x % 2 == 0 end)
+      g(2)
+      pcall(g, 3)
+      f(1)
+      local counted = {}
+      for _, site in pairs(checks.stats().sites) do
+        if site.calls > 0 then counted[#counted + 1] = {site.calls, site.slow, site.checkers} end
+      end
+      table.sort(counted, function(a, b) return a[1] > b[1] end)
+      assert.same({{2, 2, 2}, {1, 0, 0}}, counted)
+    end)
+    it("counts no registered checks when off", function()
+      checks.register('even', function(x) return x % 2 == 0 end)
+      g(2)
+      assert.is_nil(checks.stats().descriptors.even)
+    end)
+    it("measures the time", function()
+      checks.set_stats('timing')
+      f(1)
+      local stats = checks.stats()
+      assert.is_string(stats.clock)
+      assert.is_number(stats.functions.check_type.time)
+    end)
+    it("measures the time of checks failing within registered checks", function()
+      checks.set_stats('timing')
+      checks.register('even', function(x) return not pcall(f, 'x') and x % 2 == 0 end)
+      g(2)
+      g(4)
+      local stats = checks.stats()
+      assert.equal(4, stats.functions.check_type.calls)
+      assert.equal(2, stats.functions.check_type.failures)
+      assert.is_number(stats.functions.check_type.time)
+    end)
+    it("resets the counters", function()
+      checks.set_stats('on')
+      f(1)
+      checks.reset_stats()
+      local stats = checks.stats()
+      assert.equal(0, stats.functions.check_type.calls)
+      local _, site = next(stats.sites)
+      assert.equal(0, site.calls)
+    end)
+  end)
+  describe("invalidate", function()
+    local calls
+    local function g(_) checks.check_type(1, 'matrix') end
+    before_each(function()
+      calls = 0
+      checks.register('matrix', function(x)
+        calls = calls + 1
+        return type(x) == 'table' and #x > 0
+      end, {pure = true})
+    end)
+    after_each(function()
+      checks.register('matrix', nil)
+    end)
+    it("diagnoses bad options", function()
+      assert.error(function() checks.register('matrix', function() end, true) end)
+    end)
+    it("caches the results of pure checks", function()
+      local m = {{1}}
+      g(m)
+      g(m)
+      assert.error(function() g({}) end, "bad argument #1 to 'g' (matrix expected, got table)")
+      assert.error(function() g({}) end)
+      assert.equal(3, calls)
+      assert.same({hits = 1, misses = 3}, checks.stats().checkers.matrix)
+    end)
+    it("does not cache the results for other types", function()
+      pcall(g, 1)
+      pcall(g, 1)
+      assert.equal(2, calls)
+    end)
+    it("discards the results of a value", function()
+      local m = {{1}}
+      g(m)
+      m[1] = nil
+      g(m)
+      checks.invalidate(m)
+      assert.error(function() g(m) end, "bad argument #1 to 'g' (matrix expected, got table)")
+      assert.equal(2, calls)
+    end)
+    it("discards all the results", function()
+      local m, n = {{1}}, {{2}}
+      g(m)
+      g(n)
+      checks.invalidate()
+      g(m)
+      g(n)
+      assert.equal(4, calls)
+    end)
+    it("discards all the results given nil", function()
+      local m = {{1}}
+      g(m)
+      checks.invalidate(nil)
+      g(m)
+      assert.equal(2, calls)
+    end)
+    it("diagnoses values that cannot be cached", function()
+      assert.error(function() checks.invalidate(0 / 0) end,
+        "bad argument #1 to 'invalidate' (table or userdata expected, got number)")
+      assert.error(function() checks.invalidate('x') end,
+        "bad argument #1 to 'invalidate' (table or userdata expected, got string)")
+    end)
+    it("resets the counters", function()
+      g({{1}})
+      checks.reset_stats()
+      assert.same({hits = 0, misses = 0}, checks.stats().checkers.matrix)
+    end)
+  end)
+  describe("class", function()
+    local Shape, Circle, Disc = {}, {}, {}
+    local function g(_) checks.check_type(1, 'Shape') end
+    local function h(_) checks.check_type(1, 'Circle') end
+    setup(function()
+      checks.class(Shape, 'Shape')
+      checks.class(Circle, 'Circle', Shape)
+      checks.class(Disc, 'Disc', Circle)
+    end)
+    teardown(function()
+      checks.class(Disc, nil)
+      checks.class(Circle, nil)
+      checks.class(Shape, nil)
+    end)
+    it("diagnoses bad arguments", function()
+      assert.error(function() checks.class(Shape, '') end, "bad argument #2 to 'class' (name is empty)")
+      assert.error(function() checks.class({}, 'Square', {}) end, "bad argument #3 to 'class' (not a class)")
+      assert.error(function() checks.class(Shape, 'Shape', Disc) end, "bad argument #3 to 'class' (cyclic ancestry)")
+      assert.error(function() checks.class({}, 'utf8') end, "bad argument #2 to 'class' (name taken by a native check)")
+      assert.is_true(checks.is('x', 'utf8'))
+    end)
+    it("matches the instances of the class and of its subclasses", function()
+      assert.not_error(function() g(setmetatable({}, Shape)) end)
+      assert.not_error(function() g(setmetatable({}, Circle)) end)
+      assert.not_error(function() g(setmetatable({}, Disc)) end)
+      assert.not_error(function() h(setmetatable({}, Disc)) end)
+      assert.is_true(checks.is(setmetatable({}, Disc), 'Circle'))
+    end)
+    it("rejects the instances of other classes", function()
+      assert.error(function() h(setmetatable({}, Shape)) end, "bad argument #1 to 'h' (Circle expected, got table)")
+      assert.error(function() g(setmetatable({}, {__type = 'Shape2'})) end)
+      assert.error(function() g({}) end, "bad argument #1 to 'g' (Shape expected, got table)")
+      assert.is_false(checks.is('Shape', 'Shape'))
+    end)
+    it("ignores the type names of values that are not instances", function()
+      assert.error(function() g(setmetatable({}, {__type = 'Shape'})) end, "bad argument #1 to 'g' (Shape expected, got table)")
+      assert.is_false(checks.is(setmetatable({}, {__name = 'Circle'}), 'Circle|Disc'))
+      assert.is_true(checks.is(setmetatable({}, {__type = 'Square'}), 'Shape|Square'))
+    end)
+    it("undeclares a class", function()
+      local Square = {}
+      checks.class(Square, 'Square', Shape)
+      assert.is_true(checks.is(setmetatable({}, Square), 'Square'))
+      checks.class(Square, nil)
+      assert.is_false(checks.is(setmetatable({}, Square), 'Square'))
+      assert.is_false(checks.is(setmetatable({}, Square), 'Shape'))
+      assert.is_true(checks.is(setmetatable({}, {__type = 'Square'}), 'Square'))
+    end)
+    it("keeps the ancestors of a class", function()
+      local Parent, Child = {}, {}
+      checks.class(Parent, 'Parent')
+      checks.class(Child, 'Child', Parent)
+      checks.class(Parent, nil)
+      local weak = setmetatable({Parent}, {__mode = 'v'})
+      Parent = nil
+      collectgarbage()
+      collectgarbage()
+      assert.is_table(weak[1])
+      checks.class(Child, nil)
+    end)
+  end)
+  describe("is", function()
+    it("diagnoses bad descriptors", function()
+      assert.error(function() checks.is(1) end, "bad argument #2 to 'is' (string expected, got no value)")
+      assert.error(function() checks.is(1, '*integer') end, "bad argument #2 to 'is' (invalid descriptor)")
+    end)
+    it("matches values", function()
+      assert.is_true(checks.is(1, 'integer'))
+      assert.is_true(checks.is(nil, '?integer|table'))
+      assert.is_true(checks.is({1, 2}, '{integer}'))
+      assert.is_true(checks.is('one', ':one|two'))
+      assert.is_true(checks.is(8080, 'integer[1,65535]'))
+      assert.is_false(checks.is(0, 'integer[1,65535]'))
+      assert.is_false(checks.is(1.5, 'integer'))
+      assert.is_false(checks.is('three', ':one|two'))
+      assert.is_false(checks.is(setmetatable({}, {__type = 'Line'}), 'Point'))
+    end)
+    it("ignores the check level", function()
+      checks.set_level('off')
+      local ok = checks.is('x', 'integer')
+      checks.set_level('full')
+      assert.is_false(ok)
+    end)
+  end)
+  describe("which", function()
+    it("diagnoses bad descriptors", function()
+      assert.error(function() checks.which(1, 'string', '') end, "bad argument #3 to 'which' (invalid descriptor)")
+    end)
+    it("returns the first matching descriptor", function()
+      assert.equal(1, checks.which('x', 'string', 'any'))
+      assert.equal(2, checks.which({'x'}, 'string', '{string}', 'table'))
+      assert.equal(3, checks.which({1}, 'string', '{string:1}|integer', 'table'))
+      assert.is_nil(checks.which(true, 'string', 'table'))
+      assert.is_nil(checks.which(true))
+    end)
+  end)
+  describe("dispatch", function()
+    local f = checks.dispatch {
+      {'string', '?table', function(s, t) return 'string', s, t end},
+      {'table', function(t) return 'table', t end},
+      {'*integer', function(...) return 'integers', select('#', ...) end},
+    }
+    it("diagnoses bad overloads", function()
+      assert.error(function() checks.dispatch {} end, "bad argument #1 to 'dispatch' (no overloads)")
+      assert.error(function() checks.dispatch {{'string'}} end, "invalid overload 1 (function expected)")
+      assert.error(function() checks.dispatch {{'string', print}, 'x'} end, "invalid overload 2 (a string)")
+      assert.error(function() checks.dispatch {{'string|', print}} end, "invalid descriptor 1 in overload 1")
+      assert.error(function() checks.dispatch {{'*string', 'table', print}} end, "invalid descriptor 1 in overload 1")
+    end)
+    it("calls the matching overload", function()
+      assert.same({'string', 'x'}, {f('x')})
+      assert.same({'string', 'x', {}}, {f('x', {})})
+      assert.same({'table', {}}, {f({})})
+      assert.same({'integers', 0}, {f()})
+      assert.same({'integers', 3}, {f(1, 2, 3)})
+    end)
+    it("requires the arguments past the signature to be nil", function()
+      assert.same({'table', {}}, {f({}, nil)})
+      assert.error(function() f({}, 1) end)
+    end)
+    it("lists the signatures when no overload matches", function()
+      assert.error(function() f('x', 1) end,
+        "bad arguments to 'f' (got (string, number), expected (string, ?table), (table) or (*integer))")
+      assert.error(function() f(1.5) end,
+        "bad arguments to 'f' (got (number), expected (string, ?table), (table) or (*integer))")
+    end)
+  end)
+  describe("signature", function()
+    describe("bad arguments", function()
+      it("diagnoses bad descriptors", function()
+        assert.error(function() checks.signature('') end, "bad argument #1 to 'signature' (empty descriptor)")
+        assert.error(function() checks.signature('table', '*') end, "bad argument #2 to 'signature' (invalid descriptor)")
+        assert.error(function() checks.signature('*string', 'table') end, "bad argument #1 to 'signature' (invalid descriptor)")
+        assert.error(function() checks.signature({}) end, "bad argument #1 to 'signature' (string expected, got table)")
+      end)
+    end)
+    describe("checking arguments", function()
+      local sig = checks.signature('table', '?function', '*string')
+      local function f(_, _, ...) sig() end
+      local function g(_, _, ...) sig:check() end
+      it("reports errors", function()
+        assert.error(function() f() end, "bad argument #1 to 'f' (table expected, got nil)")
+        assert.error(function() f({}, 1337) end, "bad argument #2 to 'f' (nil or function expected, got number)")
+        assert.error(function() f({}, nil, 'a', 1337) end, "bad argument #4 to 'f' (string expected, got number)")
+        assert.error(function() g({}, 1337) end, "bad argument #2 to 'g' (nil or function expected, got number)")
+      end)
+      it("matches arguments", function()
+        assert.not_error(function() f({}) end)
+        assert.not_error(function() f({}, print, 'a', 'b') end)
+        assert.not_error(function() g({}, nil, 'a') end)
+      end)
+      it("requires one or more arguments", function()
+        local sig1 = checks.signature('+string')
+        local function h(...) sig1() end
+        assert.error(function() h() end, "bad argument #1 to 'h' (one or more of string expected, got no value)")
+        assert.not_error(function() h('a') end)
+      end)
+      it("blames the call site", function()
+        local code = [[
+          local function f(_) sig() end            -- 1
+          local function g() f() end               -- 2
+          local _, err = pcall(function() g() end) -- 3
+          return err                               -- 4
+        ]]
+        local err = load(code, 'caller', 'text', {sig = checks.signature('integer'), pcall = pcall})()
+        assert.matches(":2: bad argument #1 to", err)
+      end)
+    end)
+  end)
+  describe("wrap", function()
+    describe("bad arguments", function()
+      it("diagnoses bad arguments", function()
+        assert.error(function() checks.wrap() end, "bad argument #1 to 'wrap' (ldk.checks.signature expected, got no value)")
+        assert.error(function() checks.wrap(checks.signature()) end, "bad argument #2 to 'wrap' (function expected, got no value)")
+      end)
+    end)
+    describe("checking arguments", function()
+      local sig = checks.signature('table', '?function', '*string')
+      local f = checks.wrap(sig, function(t, _, ...) return t, select('#', ...) end)
+      it("reports errors", function()
+        assert.error(function() f() end, "bad argument #1 to 'f' (table expected, got no value)")
+        assert.error(function() f({}, 1337) end, "bad argument #2 to 'f' (nil or function expected, got number)")
+        assert.error(function() f({}, nil, 'a', 1337) end, "bad argument #4 to 'f' (string expected, got number)")
+      end)
+      it("calls the wrapped function", function()
+        local t = {}
+        assert.same({t, 0}, {f(t)})
+        assert.same({t, 3}, {f(t, print, table.unpack({'a', 'b', 'c'}))})
+      end)
+      it("requires one or more arguments", function()
+        local h = checks.wrap(checks.signature('+string'), function() end)
+        assert.error(function() h() end, "bad argument #1 to 'h' (one or more of string expected, got no value)")
+        assert.not_error(function() h('a') end)
+      end)
+      it("checks many arguments", function()
+        local h = checks.wrap(checks.signature('*integer'), function(...) return select('#', ...) end)
+        local args = {}
+        for i = 1, 5000 do args[i] = i end
+        assert.equal(5000, h(table.unpack(args)))
+        args[4000] = 'x'
+        assert.error(function() h(table.unpack(args)) end, "bad argument #4000 to 'h' (integer expected, got string)")
+      end)
+    end)
+  end)
+  describe("check_schema", function()
+    local options = checks.schema {
+      host = 'string',
+      port = 'integer',
+      mode = ':?read|write',
+      tls = checks.schema({ cert = 'string', verify = '?boolean' }, true),
+      limits = { [1] = 'positive', burst = '?integer' },
+    }
+    local function f(_) checks.check_schema(1, options) end
+    local function valid()
+      return { host = 'localhost', port = 80, limits = { 10 } }
+    end
+    it("diagnoses bad schemas", function()
+      assert.error(function() checks.schema() end, "bad argument #1 to 'schema' (table expected, got no value)")
+      assert.error(function() checks.schema { x = '' } end, "invalid descriptor for field 'x'")
+      assert.error(function() checks.schema { x = '*string' } end, "invalid descriptor for field 'x'")
+      assert.error(function() checks.schema { x = 1 } end, "invalid descriptor for field 'x'")
+      assert.error(function() checks.schema { '*string' } end, "invalid descriptor for field '1'")
+    end)
+    it("matches tables", function()
+      assert.not_error(function() f(valid()) end)
+      local t = valid()
+      t.mode, t.tls = 'read', { cert = 'x' }
+      assert.not_error(function() f(t) end)
+    end)
+    it("reports the bad field", function()
+      local t = valid()
+      t.port = '80'
+      assert.error(function() f(t) end, "bad argument #1 to 'f' (field 'port': integer expected, got string)")
+      t = valid()
+      t.mode = 'exec'
+      assert.error(function() f(t) end, "bad argument #1 to 'f' (field 'mode': nil, 'read' or 'write' expected, got 'exec')")
+    end)
+    it("reports the path of nested fields", function()
+      local t = valid()
+      t.tls = { cert = 1 }
+      assert.error(function() f(t) end, "bad argument #1 to 'f' (field 'tls.cert': string expected, got number)")
+      t = valid()
+      t.limits = { -1 }
+      assert.error(function() f(t) end, "bad argument #1 to 'f' (field 'limits[1]': positive expected, got number)")
+      t = valid()
+      t.limits = nil
+      assert.error(function() f(t) end, "bad argument #1 to 'f' (field 'limits': table expected, got nil)")
+    end)
+    it("reports non-table arguments", function()
+      assert.error(function() f('x') end, "bad argument #1 to 'f' (table expected, got string)")
+    end)
+    describe("with recursive schemas", function()
+      local tree = checks.schema { value = 'integer', children = '?{tree}' }
+      local function g(_) checks.check_type(1, 'tree') end
+      local function h(_) checks.check_schema(1, tree) end
+
+      setup(function() checks.register('tree', tree) end)
+      teardown(function()
+        checks.register('tree', nil)
+        checks.set_max_depth(100)
+      end)
+
+      it("matches recursive structures", function()
+        assert.not_error(function() g({ value = 1 }) end)
+        assert.not_error(function() g({ value = 1, children = { { value = 2 }, { value = 3, children = {} } } }) end)
+        assert.not_error(function() h({ value = 1, children = { { value = 2 } } }) end)
+        assert.is_true(checks.is({ { value = 1 } }, '{tree}'))
+        assert.is_false(checks.is({ value = 'x' }, 'tree'))
+      end)
+      it("terminates on cycles", function()
+        local node = { value = 1 }
+        node.children = { node, node }
+        assert.not_error(function() g(node) end)
+        local bad = { value = 1, children = {} }
+        bad.children[1] = { value = 'x', children = { bad } }
+        assert.is_false(checks.is(bad, 'tree'))
+      end)
+      it("checks shared subtables once", function()
+        local calls = 0
+        checks.register('counted', function(x) calls = calls + 1 return x == 1 end)
+        local node = checks.schema { value = 'counted', children = '?{node}' }
+        checks.register('node', node)
+        local leaf = { value = 1 }
+        local shared = { value = 1, children = { leaf, leaf, leaf } }
+        assert.is_true(checks.is({ value = 1, children = { shared, shared } }, 'node'))
+        assert.equal(3, calls)
+        checks.register('node', nil)
+        checks.register('counted', nil)
+      end)
+      it("reports the path of the bad node", function()
+        local t = { value = 1, children = { { value = 2 }, { value = 3, children = { { value = 'x' } } } } }
+        assert.error(function() g(t) end,
+          "bad argument #1 to 'g' (field 'children': element [2]: field 'children': element [1]: field 'value': integer expected, got string)")
+      end)
+      it("limits the depth", function()
+        local t = { value = 1 }
+        for i = 2, 5 do t = { value = i, children = { t } } end
+        checks.set_max_depth(4)
+        assert.error(function() g(t) end)
+        checks.set_max_depth(5)
+        assert.not_error(function() g(t) end)
+        assert.error(function() checks.set_max_depth(0) end, "bad argument #1 to 'set_max_depth' (depth out of range)")
+      end)
+      it("can be unregistered", function()
+        checks.register('tree', nil)
+        assert.error(function() g({ value = 1 }) end, "bad argument #1 to 'g' (tree expected, got table)")
+        checks.register('tree', tree)
+      end)
+      it("cannot replace the native checks", function()
+        assert.error(function() checks.register('array', tree) end,
+          "bad argument #1 to 'register' (name taken by a native check)")
+        checks.register('array', nil)
+        assert.is_true(checks.is({1, 2}, 'array'))
+        assert.is_false(checks.is({x = 1}, 'array'))
+      end)
     end)
   end)
   describe("check_type", function()
@@ -152,6 +843,22 @@ describe("#checks", function()
         assert.error(check_type(1, {1337}), "bad argument #2 to 'check_type' (string expected, got table)")
       end)
     end)
+    it("keeps the descriptors that are not cached", function()
+      for i = 1, 4200 do assert.not_error(f1(1, 'number|uncached' .. i, 1)) end
+      local sig = checks.signature('{number|uncached_element}', '?string|uncached_string')
+      local schema = checks.schema { x = '{number|uncached_field}' }
+      collectgarbage()
+      collectgarbage()
+      local function g(_, _) sig() end
+      local function h(_) checks.check_schema(1, schema) end
+      assert.error(function() g({'a'}) end)
+      assert.error(function() g({}, 1) end)
+      assert.not_error(function() g({1}, 'a') end)
+      assert.error(function() h({x = {'a'}}) end)
+      assert.not_error(function() h({x = {1}}) end)
+      assert.error(f1(1, '{number|uncached_element}', {'a'}))
+      assert.not_error(f1(1, '{number|uncached_element}', {1}))
+    end)
     describe("with primitive types", function()
       it("reports missing arguments", function()
         assert.error(f1(1, 'boolean', nil), "bad argument #1 to 'f' (boolean expected, got nil)")
@@ -234,6 +941,172 @@ describe("#checks", function()
         assert.not_error(f1(1, 'foo|goo', foo));
         assert.not_error(f1(1, 'foo|goo', goo));
       end)
+      it("matches instances sharing a metatable", function()
+        local mt = { __type = "hoo" }
+        for _ = 1, 3 do
+          assert.not_error(f1(1, 'hoo', setmetatable({}, mt)))
+          assert.error(f1(1, 'foo', setmetatable({}, mt)), "bad argument #1 to 'f' (foo expected, got table)")
+        end
+        assert.error(f1(1, 'hoo', setmetatable({}, {})), "bad argument #1 to 'f' (hoo expected, got table)")
+      end)
+      it("reads the type of a metatable again once invalidated", function()
+        local mt = { __type = "ioo" }
+        local x = setmetatable({}, mt)
+        assert.not_error(f1(1, 'ioo', x))
+        mt.__type = "joo"
+        assert.not_error(f1(1, 'ioo', x))
+        checks.invalidate(mt)
+        assert.error(f1(1, 'ioo', x), "bad argument #1 to 'f' (ioo expected, got table)")
+        assert.not_error(f1(1, 'joo', x))
+      end)
+    end)
+    describe("with multiple types", function()
+      it("matches any of the types", function()
+        assert.not_error(f1(1, 'boolean|string', 'a string'))
+        assert.not_error(f1(1, 'string|table', {}))
+        assert.not_error(f1(1, 'integer|table', 1337))
+        assert.not_error(f1(1, 'float|foo', 1.337))
+      end)
+      it("reports mismatched types", function()
+        assert.error(f1(1, 'boolean|string', {}), "bad argument #1 to 'f' (boolean or string expected, got table)")
+        assert.error(f1(1, 'integer|table', 1.337), "bad argument #1 to 'f' (integer or table expected, got number)")
+      end)
+      it("reuses the compiled descriptor", function()
+        for _ = 1, 3 do
+          assert.not_error(f1(1, '?string|table', nil))
+          assert.error(f1(1, '?string|table', 1337), "bad argument #1 to 'f' (nil, string or table expected, got number)")
+        end
+      end)
+      it("diagnoses invalid descriptors", function()
+        assert.error(f1(1, '?', 1337), "bad argument #2 to 'check_type' (invalid descriptor)")
+        assert.error(f1(1, 'string||table', 1337), "bad argument #2 to 'check_type' (invalid descriptor)")
+        assert.error(f1(1, 'string|', 1337), "bad argument #2 to 'check_type' (invalid descriptor)")
+      end)
+    end)
+    describe("with array types", function()
+      it("matches the elements", function()
+        assert.not_error(f1(1, '{integer}', {}))
+        assert.not_error(f1(1, '{integer}', {1, 2, 3}))
+        assert.not_error(f1(1, '{integer|string}', {1, 'two', 3}))
+        assert.not_error(f1(1, '?{integer}', nil))
+        assert.not_error(f1(1, '{integer}|string', 'x'))
+        assert.not_error(f1(1, '{{integer}}', {{1}, {2, 3}}))
+      end)
+      it("reports mismatched elements", function()
+        assert.error(f1(1, '{integer}', 'x'), "bad argument #1 to 'f' ({integer} expected, got string)")
+        assert.error(f1(1, '{integer}', {1, 2.5}), "bad argument #1 to 'f' (element [2]: integer expected, got number)")
+        assert.error(f1(1, '{{integer}}', {{1}, {'x'}}),
+          "bad argument #1 to 'f' (element [2]: element [1]: integer expected, got string)")
+      end)
+      it("matches named element types", function()
+        local Point = {__type = 'Point'}
+        assert.not_error(f1(1, '{Point}', {setmetatable({}, Point)}))
+        assert.error(f1(1, '{Point}', {{}}), "bad argument #1 to 'f' (element [1]: Point expected, got table)")
+      end)
+      it("limits the number of checked elements", function()
+        assert.not_error(f1(1, '{integer:2}', {1, 2, 'x'}))
+        assert.error(f1(1, '{integer:2}', {1, 'x'}), "bad argument #1 to 'f' (element [2]: integer expected, got string)")
+      end)
+      it("diagnoses invalid descriptors", function()
+        assert.error(f1(1, '{}', {}), "bad argument #2 to 'check_type' (invalid descriptor)")
+        assert.error(f1(1, '{integer', {}), "bad argument #2 to 'check_type' (invalid descriptor)")
+        assert.error(f1(1, '{*integer}', {}), "bad argument #2 to 'check_type' (invalid descriptor)")
+        assert.error(f1(1, '{integer:0}', {}), "bad argument #2 to 'check_type' (invalid descriptor)")
+        assert.error(f1(1, '{integer:2147483648}', {}), "bad argument #2 to 'check_type' (invalid descriptor)")
+        assert.error(f1(1, '{integer:99999999999999999999}', {}), "bad argument #2 to 'check_type' (invalid descriptor)")
+        assert.error(f1(1, '{integer}|{string}', {}), "bad argument #2 to 'check_type' (invalid descriptor)")
+      end)
+    end)
+    describe("with bounded types", function()
+      it("matches values within the bounds", function()
+        assert.not_error(f1(1, 'integer[0,65535]', 0))
+        assert.not_error(f1(1, 'integer[0,65535]', 65535))
+        assert.not_error(f1(1, 'number[-0.5,0.5]', 0.25))
+        assert.not_error(f1(1, 'float[,0.5]', -1.5))
+        assert.not_error(f1(1, 'string[1,255]', 'x'))
+        assert.not_error(f1(1, 'table[1,]', {1}))
+        assert.not_error(f1(1, '?string[1,]', nil))
+        assert.not_error(f1(1, 'integer[0,9]|string', 'x'))
+        assert.not_error(f1(1, 'integer[0,9]|number[100,]', 100.5))
+        assert.not_error(f1(1, '{integer[1,]}', {1, 2}))
+      end)
+      it("reports the violated bound", function()
+        assert.error(f1(1, 'integer[0,65535]', 70000),
+          "bad argument #1 to 'f' (integer[0,65535] expected, got 70000 (greater than 65535))")
+        assert.error(f1(1, 'integer[0,65535]', -1),
+          "bad argument #1 to 'f' (integer[0,65535] expected, got -1 (less than 0))")
+        assert.error(f1(1, 'number[-0.5,0.5]', 0.75),
+          "bad argument #1 to 'f' (number[-0.5,0.5] expected, got 0.75 (greater than 0.5))")
+        assert.error(f1(1, 'number[-0.5,0.5]', 0 / 0),
+          "bad argument #1 to 'f' (number[-0.5,0.5] expected, got " .. tostring(0 / 0) .. " (not a number))")
+        assert.error(f1(1, 'string[1,255]', ''),
+          "bad argument #1 to 'f' (string[1,255] expected, got a string of length 0 (shorter than 1))")
+        assert.error(f1(1, 'table[,2]', {1, 2, 3}),
+          "bad argument #1 to 'f' (table[,2] expected, got a table of length 3 (longer than 2))")
+        assert.error(f1(1, '{string[1,]}', {'x', ''}),
+          "bad argument #1 to 'f' (element [2]: string[1,] expected, got a string of length 0 (shorter than 1))")
+      end)
+      it("reports mismatched types", function()
+        assert.error(f1(1, 'integer[0,9]', 1.5), "bad argument #1 to 'f' (integer[0,9] expected, got number)")
+        assert.error(f1(1, 'string[1,]|table', 1), "bad argument #1 to 'f' (string[1,] or table expected, got number)")
+      end)
+      it("diagnoses invalid descriptors", function()
+        assert.error(f1(1, 'integer[,]', 1), "bad argument #2 to 'check_type' (invalid descriptor)")
+        assert.error(f1(1, 'integer[1]', 1), "bad argument #2 to 'check_type' (invalid descriptor)")
+        assert.error(f1(1, 'integer[2,1]', 1), "bad argument #2 to 'check_type' (invalid descriptor)")
+        assert.error(f1(1, 'integer[0.5,1]', 1), "bad argument #2 to 'check_type' (invalid descriptor)")
+        assert.error(f1(1, 'string[-1,]', ''), "bad argument #2 to 'check_type' (invalid descriptor)")
+        assert.error(f1(1, 'string[1,]|string[,9]', ''), "bad argument #2 to 'check_type' (invalid descriptor)")
+      end)
+      it("diagnoses out of range bounds", function()
+        assert.error(f1(1, 'integer[0,99999999999999999999]', 1), "bad argument #2 to 'check_type' (invalid descriptor)")
+        assert.error(f1(1, 'integer[-99999999999999999999,0]', 0), "bad argument #2 to 'check_type' (invalid descriptor)")
+        assert.error(f1(1, 'number[0,1e999]', 1), "bad argument #2 to 'check_type' (invalid descriptor)")
+        assert.not_error(f1(1, 'integer[0,9223372036854775807]', 1))
+      end)
+      it("checks only the types at the primitive level", function()
+        checks.set_level('primitive')
+        local ok = pcall(f1(1, 'integer[0,9]', 10))
+        checks.set_level('full')
+        assert.is_true(ok)
+      end)
+    end)
+    describe("with built-in checks", function()
+      it("matches callable values", function()
+        assert.not_error(f1(1, 'callable', print))
+        assert.not_error(f1(1, 'callable', setmetatable({}, {__call = print})))
+        assert.error(f1(1, 'callable', {}), "bad argument #1 to 'f' (callable expected, got table)")
+      end)
+      it("matches non-empty values", function()
+        assert.not_error(f1(1, 'nonempty', 'x'))
+        assert.not_error(f1(1, 'nonempty', {x = 1}))
+        assert.error(f1(1, 'nonempty', ''), "bad argument #1 to 'f' (nonempty expected, got string)")
+        assert.error(f1(1, 'nonempty', {}), "bad argument #1 to 'f' (nonempty expected, got table)")
+      end)
+      it("matches positive numbers", function()
+        assert.not_error(f1(1, 'positive', 1))
+        assert.not_error(f1(1, 'positive', 0.5))
+        assert.error(f1(1, 'positive', 0), "bad argument #1 to 'f' (positive expected, got number)")
+        assert.error(f1(1, 'positive', '1'), "bad argument #1 to 'f' (positive expected, got string)")
+      end)
+      it("matches arrays", function()
+        assert.not_error(f1(1, 'array', {}))
+        assert.not_error(f1(1, 'array', {1, 2, 3}))
+        assert.error(f1(1, 'array', {1, nil, 3, x = 1}), "bad argument #1 to 'f' (array expected, got table)")
+        assert.error(f1(1, '?array', {x = 1}), "bad argument #1 to 'f' (nil or array expected, got table)")
+      end)
+      it("matches the content of strings", function()
+        local large = ('caf\195\169 \226\130\172 \240\159\152\128\n'):rep(100000)
+        assert.not_error(f1(1, 'ascii', 'plain text'))
+        assert.not_error(f1(1, 'utf8', large))
+        assert.not_error(f1(1, 'printable', large))
+        assert.error(f1(1, 'ascii', 'caf\195\169'), "bad argument #1 to 'f' (ascii expected, got string)")
+        assert.error(f1(1, 'utf8', large .. '\255'), "bad argument #1 to 'f' (utf8 expected, got string)")
+        assert.error(f1(1, 'utf8', '\237\160\128'), "bad argument #1 to 'f' (utf8 expected, got string)")
+        assert.error(f1(1, 'utf8', '\192\128'), "bad argument #1 to 'f' (utf8 expected, got string)")
+        assert.error(f1(1, 'printable', 'a\0b'), "bad argument #1 to 'f' (printable expected, got string)")
+        assert.error(f1(1, 'utf8', 1), "bad argument #1 to 'f' (utf8 expected, got number)")
+      end)
     end)
     describe("with any", function()
       it("should accept anything but nil", function()
@@ -299,6 +1172,42 @@ describe("#checks", function()
         -- assert.not_error(f1(1, 'one|two', 'two'))
         assert.not_error(f1(1, '?one|two|three', nil))
       end)
+      it("diagnoses invalid options", function()
+        assert.error(f1(1, 'one||two', 'one'), "bad argument #2 to 'check_option' (invalid descriptor)")
+        assert.error(f1(1, 'one|', 'one'), "bad argument #2 to 'check_option' (invalid descriptor)")
+        assert.error(f1(1, '?', 'one'), "bad argument #2 to 'check_option' (invalid descriptor)")
+      end)
+    end)
+    describe("with large enum types", function()
+      local options = {}
+      for i = 1, 100 do options[i] = 'option' .. i end
+      local descriptor = table.concat(options, '|')
+      it("matches each option", function()
+        for i = 1, 100 do
+          assert.not_error(f1(1, descriptor, 'option' .. i))
+        end
+        assert.not_error(f1(1, '?' .. descriptor, nil))
+      end)
+      it("reports mismatched options", function()
+        assert.error(f1(1, descriptor, 'option101'))
+        assert.error(f1(1, descriptor, 'option'))
+        assert.error(f1(1, descriptor, 1), "bad argument #1 to 'f' (string expected, got number)")
+        assert.error(f1(1, 'a|b|c|d|e|f|g|h', 'i'),
+          "bad argument #1 to 'f' ('a', 'b', 'c', 'd', 'e', 'f', 'g', or 'h' expected, got 'i')")
+      end)
+      it("matches options through check_type", function()
+        local function g(x) checks.check_type(1, ':' .. descriptor) return x end
+        assert.equal('option7', g('option7'))
+        assert.error(function() g('option0') end)
+      end)
+    end)
+    describe("with many option sets", function()
+      it("checks the options past the cached ones", function()
+        for i = 1, 1100 do
+          assert.not_error(f1(1, 'a|b' .. i, 'b' .. i))
+          assert.error(f1(1, 'a|b' .. i, 'c'), ("bad argument #1 to 'f' ('a' or 'b%d' expected, got 'c')"):format(i))
+        end
+      end)
     end)
     describe("blame site", function()
       it("blames the call site", function()
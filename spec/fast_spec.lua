@@ -0,0 +1,85 @@
+-- luacheck: ignore 212
+
+describe("#fast", function()
+  local checks = require 'ldk.checks'
+  local fast = require 'ldk.checks.fast'
+
+  local Point = {__type = 'Point'}
+  local values = {
+    nil, true, false, 0, 1, -1, 1.5, 2 ^ 53, 1 / 0, 0 / 0, '', 'one', 'two', {}, {1, 2}, print,
+    function() end, coroutine.create(function() end), io.stdout, setmetatable({}, Point),
+  }
+  local value_count = 20
+
+  local descriptors = {
+    'nil', 'boolean', 'number', 'integer', 'float', 'string', 'table', 'function', 'userdata',
+    'thread', 'any', '?any', '?string', 'integer|string', '?float|table', 'number|integer',
+    ':one', ':one|two', ':?one|two', 'Point', '?Point|string', '{integer}', 'FILE*|boolean',
+  }
+
+  describe("is", function()
+    it("agrees with the library", function()
+      for _, descriptor in ipairs(descriptors) do
+        for i = 1, value_count do
+          local value = values[i]
+          assert.equal(checks.is(value, descriptor), fast.is(value, descriptor),
+            ("%s on value #%d"):format(descriptor, i))
+        end
+      end
+    end)
+    it("diagnoses invalid descriptors", function()
+      assert.error(function() fast.is(1, 'integer||string') end, "bad argument #2 to 'is' (invalid descriptor)")
+      assert.error(function() fast.is(1, '?') end, "bad argument #2 to 'is' (invalid descriptor)")
+      assert.error(function() fast.is(1, {}) end)
+    end)
+  end)
+
+  describe("which", function()
+    it("agrees with the library", function()
+      for i = 1, value_count do
+        local value = values[i]
+        assert.equal(checks.which(value, 'string', 'integer', '?table'), fast.which(value, 'string', 'integer', '?table'))
+      end
+      assert.is_nil(fast.which(1))
+    end)
+  end)
+
+  describe("check", function()
+    local function f(x) fast.check(x, '?integer|string', 1) end
+    local function g(x) checks.check_type(1, '?integer|string') end
+    local function h(_, y) fast.check(y, ':one|two', 2) end
+    local function k(_, y) checks.check_option(2, 'one|two') end
+
+    local function error_of(fn, ...)
+      local _, err = pcall(fn, ...)
+      return err
+    end
+
+    it("accepts matching values", function()
+      assert.not_error(function() f(1) end)
+      assert.not_error(function() f(nil) end)
+      assert.not_error(function() h(nil, 'two') end)
+    end)
+    it("reports errors as the library", function()
+      assert.equal((error_of(g, 1.5):gsub("'g'", "'f'")), error_of(f, 1.5))
+      assert.equal((error_of(k, nil, 'three'):gsub("'k'", "'h'")), error_of(h, nil, 'three'))
+    end)
+    it("blames the caller", function()
+      local err = error_of(function() f({}) end)
+      assert.matches("bad argument #1 to 'f' (nil, integer or string expected, got table)", err, 1, true)
+    end)
+    it("honours the check level", function()
+      checks.set_level('off')
+      assert.not_error(function() f({}) end)
+      checks.set_level('full')
+    end)
+  end)
+
+  describe("math_type", function()
+    it("agrees with math.type", function()
+      for i = 1, value_count do
+        assert.equal(math.type(values[i]), fast.math_type(values[i]))
+      end
+    end)
+  end)
+end)
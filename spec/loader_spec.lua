@@ -0,0 +1,146 @@
+-- luacheck: ignore 212
+
+describe("#loader", function()
+  local loader = require 'ldk.checks.loader'
+
+  local source = [[
+local checks = require 'ldk.checks'
+local check_type, check_option = checks.check_type, checks.check_option
+local check_types = require('ldk.checks').check_types
+local M = {}
+function M.concat(s, n, sep)
+  check_types('string', 'integer', '?string')
+  return s .. (sep or '') .. n
+end
+function M.mode(mode)
+  check_option(1, 'read|write')
+  return mode
+end
+function M.size(t)
+  check_type(1, 'table')
+  checks.check_arg(1, #t > 0, 'empty table')
+  return #t
+end
+function M.kind(x)
+  check_type(1, 'Point')
+  return getmetatable(x).__type
+end
+function M.line()
+  local info = debug.getinfo(1, 'l')
+  return info.currentline
+end
+return M
+]]
+
+  local function load_module(text)
+    return assert(load(text, '=module'))()
+  end
+
+  local Point = {__type = 'Point'}
+
+  local function behaves_like(original, rewritten)
+    assert.equal(original.concat('a', 1), rewritten.concat('a', 1))
+    assert.equal(original.concat('a', 1, '-'), rewritten.concat('a', 1, '-'))
+    assert.equal(original.mode('read'), rewritten.mode('read'))
+    assert.equal(original.size({1, 2}), rewritten.size({1, 2}))
+    assert.equal(original.kind(setmetatable({}, Point)), rewritten.kind(setmetatable({}, Point)))
+    assert.equal(original.line(), rewritten.line())
+  end
+
+  local function error_of(f, ...)
+    local _, err = pcall(f, ...)
+    return err
+  end
+
+  describe("rewrite", function()
+    it("diagnoses bad modes", function()
+      assert.error(function() loader.rewrite(source, 'fast') end, "bad argument #2 to 'rewrite' (invalid mode 'fast')")
+    end)
+    it("strips the checks", function()
+      local text, count = loader.rewrite(source, 'strip')
+      assert.equal(5, count)
+      assert.not_matches('check_type%(', text)
+      local original, rewritten = load_module(source), load_module(text)
+      behaves_like(original, rewritten)
+      assert.error(function() original.mode('append') end)
+      assert.not_error(function() rewritten.mode('append') end)
+    end)
+    it("inlines the primitive checks", function()
+      local text, count = loader.rewrite(source, 'inline')
+      assert.equal(4, count)
+      assert.matches("check_type(1, 'Point')", text, 1, true)
+      local original, rewritten = load_module(source), load_module(text)
+      behaves_like(original, rewritten)
+      assert.equal(error_of(original.concat, 'a', 'b'), error_of(rewritten.concat, 'a', 'b'))
+      assert.equal(error_of(original.mode, 'append'), error_of(rewritten.mode, 'append'))
+      assert.equal(error_of(original.size, {}), error_of(rewritten.size, {}))
+      assert.equal(error_of(original.kind, {}), error_of(rewritten.kind, {}))
+    end)
+    it("keeps the calls with side effects", function()
+      local text, count = loader.rewrite([[
+        local checks = require 'ldk.checks'
+        local function f(x) checks.check_arg(1, validate(x)) end
+      ]], 'strip')
+      assert.equal(0, count)
+      assert.matches('validate', text)
+    end)
+    it("ignores unbound names", function()
+      local text = [[
+        local checks = require 'ldk.checks'
+        local check_type, check_option = checks.check_type, checks.check_option
+        local check_type = function() end
+        local function check_option() end
+        local function f(x) check_type(1, 'string') check_option(1, 'a') end
+      ]]
+      assert.equal(0, select(2, loader.rewrite(text, 'strip')))
+    end)
+  end)
+
+  describe("install", function()
+    local base = os.tmpname()
+    local path = package.path
+
+    setup(function()
+      local file = assert(io.open(base .. '_sample.lua', 'w'))
+      file:write(source)
+      file:close()
+      package.path = base .. '_?.lua;' .. path
+    end)
+
+    teardown(function()
+      os.remove(base .. '_sample.lua')
+      os.remove(base)
+      package.path = path
+    end)
+
+    after_each(function()
+      loader.uninstall()
+      package.loaded.sample = nil
+    end)
+
+    it("diagnoses bad arguments", function()
+      assert.error(function() loader.install('fast') end, "bad argument #1 to 'install' (invalid mode 'fast')")
+      assert.error(function() loader.install('strip', 1) end,
+        "bad argument #2 to 'install' (string or function expected, got number)")
+    end)
+    it("rewrites the loaded modules", function()
+      loader.install('strip', '^sample$')
+      local sample = require 'sample'
+      assert.equal('read', sample.mode('read'))
+      assert.not_error(function() sample.mode('append') end)
+    end)
+    it("leaves the filtered out modules alone", function()
+      loader.install('strip', function(name) return name ~= 'sample' end)
+      local sample = require 'sample'
+      assert.error(function() sample.mode('append') end)
+    end)
+    it("can be uninstalled", function()
+      local count = #package.searchers
+      loader.install('inline')
+      loader.install('strip')
+      assert.equal(count + 1, #package.searchers)
+      loader.uninstall()
+      assert.equal(count, #package.searchers)
+    end)
+  end)
+end)
@@ -0,0 +1,156 @@
+// Checks that the vector kernels of libtext return the same results as the scalar ones, on every
+// sequence of up to three bytes, on sampled sequences of four bytes, and on random strings of
+// valid and corrupted UTF-8, at every alignment around the block boundaries.
+
+#include "libtext.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PADDING 40
+#define RANDOM_STRINGS 200000
+#define MAX_LENGTH 300
+
+static const char *const isa_names[] = {"scalar", "sse2", "avx2"};
+
+static textL_isa best_isa;
+static long failures = 0;
+
+static uint64_t random_state = 0x9E3779B97F4A7C15u;
+
+static uint32_t next_random(void)
+{
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 7;
+    random_state ^= random_state << 17;
+    return (uint32_t)(random_state >> 32);
+}
+
+static void report(const char *kernel, textL_isa isa, const unsigned char *s, size_t len)
+{
+    if (++failures > 10) return;
+    fprintf(stderr, "%s: %s differs from scalar on %zu bytes:", kernel, isa_names[isa], len);
+    for (size_t i = 0; i < len && i < 64; i++) fprintf(stderr, " %02x", s[i]);
+    fprintf(stderr, "\n");
+}
+
+static void compare(const unsigned char *s, size_t len)
+{
+    const char *p = (const char *)s;
+    textL_setisa(TEXTL_SCALAR);
+    bool ascii = textL_isascii(p, len);
+    bool utf8 = textL_isutf8(p, len);
+    bool printable = textL_isprintable(p, len);
+    for (int isa = TEXTL_SSE2; isa <= (int)best_isa; isa++)
+    {
+        textL_setisa((textL_isa)isa);
+        if (textL_isascii(p, len) != ascii) report("ascii", (textL_isa)isa, s, len);
+        if (textL_isutf8(p, len) != utf8) report("utf8", (textL_isa)isa, s, len);
+        if (textL_isprintable(p, len) != printable) report("printable", (textL_isa)isa, s, len);
+    }
+}
+
+// places `n` bytes in a string of ASCII letters, at every offset around the end of the first block.
+static void compare_sequence(const unsigned char *seq, size_t n, size_t first, size_t last)
+{
+    unsigned char buffer[PADDING * 2];
+    for (size_t offset = first; offset <= last; offset++)
+    {
+        memset(buffer, 'a', sizeof(buffer));
+        memcpy(buffer + offset, seq, n);
+        compare(buffer, PADDING);
+        compare(buffer, offset + n);
+    }
+}
+
+static size_t append_code_point(unsigned char *s, uint32_t c)
+{
+    if (c < 0x80)
+    {
+        s[0] = (unsigned char)c;
+        return 1;
+    }
+    if (c < 0x800)
+    {
+        s[0] = (unsigned char)(0xC0 | (c >> 6));
+        s[1] = (unsigned char)(0x80 | (c & 0x3F));
+        return 2;
+    }
+    if (c < 0x10000)
+    {
+        s[0] = (unsigned char)(0xE0 | (c >> 12));
+        s[1] = (unsigned char)(0x80 | ((c >> 6) & 0x3F));
+        s[2] = (unsigned char)(0x80 | (c & 0x3F));
+        return 3;
+    }
+    s[0] = (unsigned char)(0xF0 | (c >> 18));
+    s[1] = (unsigned char)(0x80 | ((c >> 12) & 0x3F));
+    s[2] = (unsigned char)(0x80 | ((c >> 6) & 0x3F));
+    s[3] = (unsigned char)(0x80 | (c & 0x3F));
+    return 4;
+}
+
+static size_t random_string(unsigned char *s, size_t max)
+{
+    static const uint32_t limits[] = {0x80, 0x800, 0x10000, 0x110000};
+    size_t target = next_random() % max;
+    size_t len = 0;
+    bool ascii = next_random() % 4 == 0;
+    while (len + 4 <= target)
+    {
+        uint32_t c = next_random() % limits[ascii ? 0 : next_random() % 4];
+        len += append_code_point(s + len, c);
+    }
+    // corrupts some strings
+    switch (next_random() % 4)
+    {
+        case 0:
+            if (len > 0) s[next_random() % len] = (unsigned char)next_random();
+            break;
+        case 1:
+            if (len > 0) len--;
+            break;
+    }
+    return len;
+}
+
+int main(void)
+{
+    best_isa = textL_setisa(TEXTL_AVX2);
+    printf("testing the %s kernels\n", isa_names[best_isa]);
+    if (best_isa == TEXTL_SCALAR) return 0;
+
+    unsigned char seq[4];
+    for (uint32_t v = 0; v < 0x1000000; v++)
+    {
+        seq[0] = (unsigned char)(v >> 16);
+        seq[1] = (unsigned char)(v >> 8);
+        seq[2] = (unsigned char)v;
+        compare_sequence(seq, 3, 30, 30);
+        if (v < 0x10000) compare_sequence(seq + 1, 2, 0, 33);
+    }
+    for (int i = 0; i < 4000000; i++)
+    {
+        uint32_t v = next_random();
+        memcpy(seq, &v, sizeof(v));
+        seq[0] |= 0xF0;
+        compare_sequence(seq, 4, 29, 29);
+    }
+
+    unsigned char buffer[MAX_LENGTH + 4];
+    for (int i = 0; i < RANDOM_STRINGS; i++)
+    {
+        size_t len = random_string(buffer, MAX_LENGTH);
+        compare(buffer, len);
+    }
+
+    if (failures > 0)
+    {
+        fprintf(stderr, "%ld failures\n", failures);
+        return EXIT_FAILURE;
+    }
+    printf("ok\n");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,96 @@
+// Runs independent Lua states on concurrent threads, each registering its own checkers, and
+// verifies that no state observes the checkers of another.
+
+#include <lauxlib.h>
+#include <lualib.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+extern int luaopen_ldk_checks(lua_State *L);
+
+#define THREAD_COUNT 16
+#define ITERATIONS 20000
+
+static const char script[] = //
+    "local checks, id, iterations = ...\n"
+    "local name, other = 'kind' .. id, 'kind' .. (id + 1)\n"
+    "local function checker(v) return type(v) == 'table' and v.id == id end\n"
+    "local function f(_) checks.check_type(1, name) end\n"
+    "local function g(_) checks.check_type(1, other) end\n"
+    "local mine, theirs = {id = id}, {id = id + 1}\n"
+    "checks.register(name, checker)\n"
+    "for i = 1, iterations do\n"
+    "  f(mine)\n"
+    "  if pcall(f, theirs) then error('accepted a value of another kind') end\n"
+    "  if pcall(g, theirs) then error('used the checker of another state') end\n"
+    "  if i % 100 == 0 then\n"
+    "    checks.register(name, nil)\n"
+    "    if pcall(f, mine) then error('used an unregistered checker') end\n"
+    "    checks.register(name, checker)\n"
+    "  end\n"
+    "end\n";
+
+typedef struct
+{
+    int id;
+    const char *error;
+    char message[256];
+} worker;
+
+static void *run(void *arg)
+{
+    worker *w = (worker *)arg;
+
+    lua_State *L = luaL_newstate();
+    luaL_openlibs(L);
+    luaL_requiref(L, "ldk.checks", luaopen_ldk_checks, 0); // checks
+    if (luaL_loadbuffer(L, script, sizeof(script) - 1, "=threads") != LUA_OK)
+    {
+        snprintf(w->message, sizeof(w->message), "%s", lua_tostring(L, -1));
+        w->error = w->message;
+        lua_close(L);
+        return NULL;
+    }
+    lua_insert(L, -2);                // script checks
+    lua_pushinteger(L, w->id);        // script checks id
+    lua_pushinteger(L, ITERATIONS);   // script checks id iterations
+    if (lua_pcall(L, 3, 0, 0) != LUA_OK)
+    {
+        snprintf(w->message, sizeof(w->message), "%s", lua_tostring(L, -1));
+        w->error = w->message;
+    }
+    lua_close(L);
+    return NULL;
+}
+
+int main(void)
+{
+    pthread_t threads[THREAD_COUNT];
+    worker workers[THREAD_COUNT];
+
+    for (int i = 0; i < THREAD_COUNT; i++)
+    {
+        workers[i].id = i;
+        workers[i].error = NULL;
+        if (pthread_create(&threads[i], NULL, run, &workers[i]) != 0)
+        {
+            fprintf(stderr, "cannot create thread %d\n", i);
+            return EXIT_FAILURE;
+        }
+    }
+
+    int failures = 0;
+    for (int i = 0; i < THREAD_COUNT; i++)
+    {
+        pthread_join(threads[i], NULL);
+        if (workers[i].error != NULL)
+        {
+            fprintf(stderr, "thread %d: %s\n", i, workers[i].error);
+            failures++;
+        }
+    }
+
+    printf("%d threads, %d failures\n", THREAD_COUNT, failures);
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
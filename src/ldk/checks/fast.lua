@@ -0,0 +1,169 @@
+--- Checks of values that the LuaJIT compiler can trace.
+--
+-- The functions of @{ldk.checks} are C functions reading the arguments of their caller with
+-- `lua_getlocal`, so under LuaJIT a loop running a check is not compiled. The functions of this
+-- module take the value to check instead, and test primitive descriptors (made of `nil`,
+-- `boolean`, `number`, `integer`, `float`, `string`, `table`, `function`, `userdata`, `thread`,
+-- `any` or of options) in Lua, with a predicate compiled on first use; the other descriptors are
+-- tested by @{ldk.checks.is}. A failing check is reported by @{ldk.checks.check_type}, so the
+-- error is the same as the one of the library.
+--
+-- The module works with any Lua version supported by the library.
+-- @module ldk.checks.fast
+
+local checks = require 'ldk.checks'
+
+local type, select, error = type, select, error
+local floor = math.floor
+local c_is, check_type = checks.is, checks.check_type
+local load = loadstring or load -- luacheck: ignore 113
+
+local M = {}
+
+--- Returns the subtype of a number, like `math.type`.
+--
+-- LuaJIT numbers have no integer subtype: a number is an integer if it has an integral value
+-- representable as a 64-bit integer, as for the library.
+-- @function math_type
+-- @param x the value.
+-- @treturn ?string `'integer'`, `'float'`, or `nil` if `x` is not a number.
+M.math_type = math.type or function(x)
+  if type(x) ~= 'number' then return nil end
+  if x == floor(x) and x >= -2 ^ 63 and x < 2 ^ 63 then return 'integer' end
+  return 'float'
+end
+local math_type = M.math_type
+
+local PRIMITIVES = {
+  ['nil'] = true, boolean = true, number = true, string = true, table = true, ['function'] = true,
+  userdata = true, thread = true,
+}
+
+-- returns the predicate of a descriptor.
+local function compile(descriptor)
+  if type(descriptor) ~= 'string' then c_is(nil, descriptor) end -- raises
+  local is_option = descriptor:sub(1, 1) == ':'
+  local body = is_option and descriptor:sub(2) or descriptor
+  local nullable = body:sub(1, 1) == '?'
+  if nullable then body = body:sub(2) end
+
+  local names, count = {}, 0
+  for alternative in (body .. '|'):gmatch('([^|]*)|') do
+    if alternative == '' then
+      names = nil
+      break
+    end
+    names[alternative] = true
+    count = count + 1
+  end
+
+  if names and is_option then
+    return function(v) return v == nil and nullable or names[v] == true and type(v) == 'string' end
+  end
+
+  if names then
+    for name in pairs(names) do
+      if not (PRIMITIVES[name] or name == 'integer' or name == 'float' or name == 'any') then
+        names = nil
+        break
+      end
+    end
+  end
+  if not names then
+    c_is(nil, descriptor) -- raises if the descriptor is invalid
+    return function(v) return c_is(v, descriptor) end
+  end
+
+  if nullable then names['nil'] = true end
+  if names.any then
+    return names['nil'] and function() return true end or function(v) return v ~= nil end
+  end
+  local integer, float = names.integer, names.float
+  if count == 1 and not nullable and not integer and not float then
+    local name = next(names)
+    return function(v) return type(v) == name end
+  end
+  return function(v)
+    local t = type(v)
+    if names[t] then return true end
+    if t ~= 'number' then return false end
+    local subtype = math_type(v)
+    return subtype == 'integer' and integer == true or subtype == 'float' and float == true
+  end
+end
+
+local predicates = setmetatable({}, {
+  __index = function(t, descriptor)
+    local predicate = compile(descriptor)
+    t[descriptor] = predicate
+    return predicate
+  end,
+})
+
+-- reporters[n] passes a value as the n-th parameter of a function calling check_type on it, so
+-- the library reports a failing check; the level is relative to the caller of the reporter.
+local reporters = setmetatable({}, {
+  __index = function(t, n)
+    local params, nils = {}, {}
+    for i = 1, n - 1 do
+      params[i] = '_' .. i .. ', '
+      nils[i] = 'nil, '
+    end
+    local reporter = load(([[
+      local check_type = ...
+      local function report(%svalue, descriptor, level) check_type(%d, descriptor, level) end
+      return function(value, descriptor, level) report(%svalue, descriptor, level + 2) end
+    ]]):format(table.concat(params), n, table.concat(nils)))(check_type)
+    t[n] = reporter
+    return reporter
+  end,
+})
+
+--- Returns whether a value matches a descriptor.
+--
+-- Same as @{ldk.checks.is}; the test of a primitive descriptor is traced by LuaJIT.
+-- @function is
+-- @param value the value to test.
+-- @tparam string expected the descriptor of the expected type.
+-- @treturn bool `true` if the value matches the descriptor; `false` otherwise.
+function M.is(value, expected)
+  return predicates[expected](value)
+end
+
+--- Returns the position of the first descriptor a value matches.
+--
+-- Same as @{ldk.checks.which}; the tests of primitive descriptors are traced by LuaJIT.
+-- @function which
+-- @param value the value to test.
+-- @tparam string ... the descriptors to test the value against.
+-- @treturn ?integer the position of the first matching descriptor, or `nil`.
+function M.which(value, ...)
+  for i = 1, select('#', ...) do
+    if predicates[select(i, ...)](value) then return i end
+  end
+  return nil
+end
+
+--- Checks that a value, the argument at position `arg` of the calling function, matches a
+-- descriptor.
+--
+-- The error raised if the value does not match is the one that @{ldk.checks.check_type} would
+-- raise for the argument; the check level applies only to failing checks.
+-- @function check
+-- @param value the value to check.
+-- @tparam string expected the descriptor of the expected type.
+-- @tparam integer arg the position of the argument.
+-- @tparam[opt=1] integer level the level in the call stack at which to report the error.
+-- @usage
+--    local function foo(n)
+--      check(n, 'integer', 1)
+--      ...
+function M.check(value, expected, arg, level)
+  if predicates[expected](value) then return end
+  if type(arg) ~= 'number' or arg < 1 or arg ~= floor(arg) then
+    error(("bad argument #3 to 'check' (positive integer expected, got %s)"):format(tostring(arg)), 2)
+  end
+  reporters[arg](value, expected, (level or 1) + 1)
+end
+
+return M
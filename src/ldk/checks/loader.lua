@@ -0,0 +1,491 @@
+--- Load-time elision of the checks.
+--
+-- The loader is a searcher, installed in `package.searchers`, that rewrites the source of Lua
+-- modules before loading them. It finds the statements that call @{ldk.checks.check_type},
+-- @{ldk.checks.check_types}, @{ldk.checks.check_option} and @{ldk.checks.check_arg} through
+-- names bound to the `ldk.checks` module:
+--
+--    local checks = require 'ldk.checks'
+--    local check_type = checks.check_type
+--    local check_types = require('ldk.checks').check_types
+--
+-- and, depending on the mode:
+--
+-- - `strip` removes them; only the calls whose arguments do not call functions are removed;
+-- - `inline` guards them with a test of the arguments written in Lua, so the library is called
+--   only when the test fails, and reports the error as it would have done. Only the descriptors
+--   made of primitive types (`nil`, `boolean`, `number`, `integer`, `float`, `string`, `table`,
+--   `function`, `userdata`, `thread`, `any`) and of options are inlined, and only for arguments
+--   that are named parameters of the enclosing function; the other calls are left as they are.
+--
+-- The line numbers of the rewritten modules are the same as the line numbers of the originals.
+-- The names of the bindings are assumed not to be shadowed or assigned after their declaration.
+-- @module ldk.checks.loader
+
+local M = {}
+
+local CHECKS = {check_type = true, check_types = true, check_option = true, check_arg = true}
+
+local KEYWORDS = {}
+for k in ([[
+  and break do else elseif end false for function goto if in local nil not or repeat return then
+  true until while
+]]):gmatch('%a+') do KEYWORDS[k] = true end
+
+local OPERATORS3 = {['...'] = true}
+local OPERATORS2 = {}
+for op in ('== ~= <= >= // :: << >> ..'):gmatch('%S+') do OPERATORS2[op] = true end
+
+-- tokens after which a name starts an expression rather than a statement
+local EXPRESSION_PREFIXES = {}
+for op in ([[
+  = , ( [ { . : + - * / // % ^ # & ~ | << >> .. == ~= < <= > >=
+  and or not return local in until if elseif while function for goto
+]]):gmatch('%S+') do EXPRESSION_PREFIXES[op] = true end
+
+-- tokens after a call that continue the expression
+local CALL_SUFFIXES = {['.'] = true, [':'] = true, ['['] = true, ['('] = true, ['{'] = true}
+
+local OPENING = {['('] = ')', ['['] = ']', ['{'] = '}'}
+
+-- primitive types of the descriptors and the Lua expressions testing them; `%s` is the argument
+local TYPE_TESTS = {
+  ['nil'] = '%s == nil',
+  any = '%s ~= nil',
+  boolean = "__checks_type(%s) == 'boolean'",
+  number = "__checks_type(%s) == 'number'",
+  string = "__checks_type(%s) == 'string'",
+  table = "__checks_type(%s) == 'table'",
+  ['function'] = "__checks_type(%s) == 'function'",
+  userdata = "__checks_type(%s) == 'userdata'",
+  thread = "__checks_type(%s) == 'thread'",
+  integer = "__checks_math_type(%s) == 'integer'",
+  float = "__checks_math_type(%s) == 'float'",
+}
+
+-- prepended to the first line of the modules with inlined checks, so they do not depend on the
+-- globals `type` and `math` being left alone by the module.
+local PRELUDE = "local __checks_type, __checks_math_type = type, math.type or require('ldk.checks.fast').math_type; "
+
+local function long_bracket_end(source, s)
+  local level = source:match('^%[(=*)%[', s)
+  if not level then return nil end
+  local _, e = source:find(']' .. level .. ']', s, true)
+  if not e then error(('unfinished long bracket at position %d'):format(s), 0) end
+  return e
+end
+
+local function string_end(source, s)
+  local quote = source:byte(s)
+  local i = s + 1
+  while true do
+    local c = source:byte(i)
+    if c == nil or c == 10 or c == 13 then
+      error(('unfinished string at position %d'):format(s), 0)
+    elseif c == 92 then -- '\\'
+      i = i + 2
+    elseif c == quote then
+      return i
+    else
+      i = i + 1
+    end
+  end
+end
+
+local function number_end(source, s)
+  local e = select(2, source:find('^0[xX][%x%.]*', s))
+  if e then
+    return select(2, source:find('^[pP][+-]?%d+', e + 1)) or e
+  end
+  e = select(2, source:find('^%d*%.?%d*', s))
+  return select(2, source:find('^[eE][+-]?%d+', e + 1)) or e
+end
+
+-- splits a chunk into tokens, each a table with its `kind` ('name', 'keyword', 'string', 'number'
+-- or 'op'), its `text`, and its start `s` and end `e` positions.
+local function tokenize(source)
+  local tokens = {}
+  local pos = 1
+  if source:sub(1, 1) == '#' then
+    pos = source:find('\n', 1, true) or #source + 1
+  end
+  while true do
+    local s = source:find('%S', pos)
+    if not s then break end
+    local c = source:sub(s, s)
+    local kind, e
+    if source:find('^%-%-', s) then
+      e = long_bracket_end(source, s + 2) or source:find('\n', s, true) or #source
+    elseif c == '"' or c == "'" then
+      kind, e = 'string', string_end(source, s)
+    elseif c == '[' and source:find('^%[=*%[', s) then
+      kind, e = 'string', long_bracket_end(source, s)
+    elseif c:find('%d') or source:find('^%.%d', s) then
+      kind, e = 'number', number_end(source, s)
+    elseif c:find('[%a_]') then
+      e = select(2, source:find('^[%w_]+', s))
+      kind = KEYWORDS[source:sub(s, e)] and 'keyword' or 'name'
+    elseif OPERATORS3[source:sub(s, s + 2)] then
+      kind, e = 'op', s + 2
+    elseif OPERATORS2[source:sub(s, s + 1)] then
+      kind, e = 'op', s + 1
+    else
+      kind, e = 'op', s
+    end
+    if kind then
+      tokens[#tokens + 1] = {kind = kind, text = source:sub(s, e), s = s, e = e}
+    end
+    pos = e + 1
+  end
+  return tokens
+end
+
+local function string_value(token)
+  if token and token.kind == 'string' then
+    return load('return ' .. token.text, '=string', 't', {})()
+  end
+end
+
+local function integer_value(token)
+  if token and token.kind == 'number' then
+    local n = tonumber(token.text)
+    if n and n >= 1 and n == math.floor(n) then return math.floor(n) end
+  end
+end
+
+-- returns the index of the token closing the bracket at index `i`.
+local function matching(tokens, i)
+  local depth = 0
+  for j = i, #tokens do
+    local text = tokens[j].kind == 'op' and tokens[j].text
+    if OPENING[text] then
+      depth = depth + 1
+    elseif text == ')' or text == ']' or text == '}' then
+      depth = depth - 1
+      if depth == 0 then return j end
+    end
+  end
+end
+
+-- returns whether the tokens from `i` to `j` contain a function call.
+local function has_call(tokens, i, j)
+  for k = i + 1, j do
+    local t, prev = tokens[k], tokens[k - 1]
+    local calls = t.kind == 'string' or (t.kind == 'op' and (t.text == '(' or t.text == '{'))
+    local callee = prev.kind == 'name' or (prev.kind == 'op' and (prev.text == ')' or prev.text == ']'))
+    if calls and callee then return true end
+  end
+  return false
+end
+
+-- splits the arguments between the brackets at `open` and `close` into ranges of tokens.
+local function split_arguments(tokens, open, close)
+  local args = {}
+  local depth, first = 0, open + 1
+  for k = open + 1, close - 1 do
+    local text = tokens[k].kind == 'op' and tokens[k].text
+    if OPENING[text] then
+      depth = depth + 1
+    elseif text == ')' or text == ']' or text == '}' then
+      depth = depth - 1
+    elseif text == ',' and depth == 0 then
+      args[#args + 1] = {first, k - 1}
+      first = k + 1
+    end
+  end
+  if first <= close - 1 then args[#args + 1] = {first, close - 1} end
+  return args
+end
+
+-- returns the Lua expression testing whether `name` matches a descriptor, or nil if the
+-- descriptor cannot be inlined.
+local function descriptor_test(descriptor, name)
+  if type(descriptor) ~= 'string' or descriptor == '' then return nil end
+  local is_option = descriptor:sub(1, 1) == ':'
+  local body = is_option and descriptor:sub(2) or descriptor
+  local tests = {}
+  if body:sub(1, 1) == '?' then
+    tests[1] = name .. ' == nil'
+    body = body:sub(2)
+  end
+  if body == '' then return nil end
+  for alternative in (body .. '|'):gmatch('([^|]*)|') do
+    if alternative == '' or alternative:find('[\r\n]') then return nil end
+    if is_option then
+      tests[#tests + 1] = ('%s == %q'):format(name, alternative)
+    else
+      local test = TYPE_TESTS[alternative]
+      if not test then return nil end
+      tests[#tests + 1] = test:format(name)
+    end
+  end
+  return table.concat(tests, ' or ')
+end
+
+local function count_newlines(s)
+  return select(2, s:gsub('\n', '\n'))
+end
+
+-- parses the parameters of a function, from the token after the `function` keyword; returns the
+-- list of the names of the parameters.
+local function function_parameters(tokens, i)
+  local params = {}
+  while tokens[i] and (tokens[i].kind == 'name' or tokens[i].text == '.') do i = i + 1 end
+  if tokens[i] and tokens[i].text == ':' then
+    params[1] = 'self'
+    i = i + 2
+  end
+  if not (tokens[i] and tokens[i].text == '(') then return params end
+  for k = i + 1, #tokens do
+    local t = tokens[k]
+    if t.text == ')' then break end
+    if t.kind == 'name' then params[#params + 1] = t.text end
+  end
+  return params
+end
+
+-- recognizes `require 'ldk.checks'` and `require('ldk.checks')` at index `i`; returns the index of
+-- the last token.
+local function require_checks(tokens, i)
+  if not (tokens[i] and tokens[i].text == 'require' and tokens[i].kind == 'name') then return nil end
+  if string_value(tokens[i + 1]) == 'ldk.checks' then return i + 1 end
+  if tokens[i + 1] and tokens[i + 1].text == '(' and string_value(tokens[i + 2]) == 'ldk.checks'
+     and tokens[i + 3] and tokens[i + 3].text == ')' then
+    return i + 3
+  end
+end
+
+-- processes the `local` statement at index `i`, updating the bindings of the module and of the
+-- check functions.
+local function bind_locals(tokens, i, modules, functions)
+  local names = {}
+  local k = i + 1
+  if tokens[k] and tokens[k].text == 'function' and tokens[k + 1] then
+    modules[tokens[k + 1].text], functions[tokens[k + 1].text] = nil, nil
+    return
+  end
+  while tokens[k] and tokens[k].kind == 'name' do
+    names[#names + 1] = tokens[k].text
+    k = k + 1
+    if tokens[k] and tokens[k].text == '<' then k = k + 3 end -- attribute
+    if not (tokens[k] and tokens[k].text == ',') then break end
+    k = k + 1
+  end
+  for _, name in ipairs(names) do
+    modules[name], functions[name] = nil, nil
+  end
+  if not (tokens[k] and tokens[k].text == '=') then return end
+
+  k = k + 1
+  for _, name in ipairs(names) do
+    local last = require_checks(tokens, k)
+    local module, field
+    if last then
+      module = true
+      if tokens[last + 1] and tokens[last + 1].text == '.' then
+        module, field, last = nil, tokens[last + 2], last + 2
+      end
+    elseif tokens[k] and modules[tokens[k].text] and tokens[k + 1] and tokens[k + 1].text == '.' then
+      field, last = tokens[k + 2], k + 2
+    end
+    if not last then return end
+    local after = tokens[last + 1]
+    if not (after == nil or after.kind == 'name' or after.text == ',' or after.text == ';'
+            or after.kind == 'keyword' and after.text ~= 'and' and after.text ~= 'or') then
+      return
+    end
+    if module then
+      modules[name] = true
+    elseif field and field.kind == 'name' and CHECKS[field.text] then
+      functions[name] = field.text
+    end
+    if not (after and after.text == ',') then return end
+    k = last + 2
+  end
+end
+
+-- returns the replacement of a call to the check function `fn`, or nil if the call is kept.
+local function rewrite_call(source, tokens, mode, fn, first, open, close, params)
+  local args = split_arguments(tokens, open, close)
+  local function text(range) return source:sub(tokens[range[1]].s, tokens[range[2]].e) end
+  local call = source:sub(tokens[first].s, tokens[close].e)
+
+  if mode == 'strip' then
+    if has_call(tokens, open, close) then return nil end
+    return ';' .. ('\n'):rep(count_newlines(call))
+  end
+
+  if fn == 'check_arg' then
+    if #args < 2 or not integer_value(tokens[args[1][1]]) then return nil end
+    if has_call(tokens, args[2][2] + 1, close) then return nil end
+    local rest = {}
+    for k = 3, #args do rest[#rest + 1] = ', ' .. text(args[k]) end
+    local replacement = ('if not (%s) then %s(%s, false%s) end'):format(text(args[2]),
+      source:sub(tokens[first].s, tokens[open - 1].e), text(args[1]), table.concat(rest))
+    return replacement .. ('\n'):rep(count_newlines(call) - count_newlines(replacement))
+  end
+
+  if not params then return nil end
+  if has_call(tokens, open, close) then return nil end
+  local tests = {}
+  if fn == 'check_type' or fn == 'check_option' then
+    if #args < 2 or args[2][1] ~= args[2][2] then return nil end
+    local arg = integer_value(tokens[args[1][1]])
+    local descriptor = string_value(tokens[args[2][1]])
+    if fn == 'check_option' and descriptor then descriptor = ':' .. descriptor end
+    if not arg or not params[arg] then return nil end
+    tests[1] = descriptor_test(descriptor, params[arg])
+  else -- check_types
+    local n = #args
+    if n > 0 and integer_value(tokens[args[n][1]]) and args[n][1] == args[n][2] then n = n - 1 end
+    if n > #params then return nil end
+    for k = 1, n do
+      if args[k][1] ~= args[k][2] then return nil end
+      tests[k] = descriptor_test(string_value(tokens[args[k][1]]), params[k])
+      if not tests[k] then return nil end
+      tests[k] = '(' .. tests[k] .. ')'
+    end
+  end
+  if #tests == 0 or not tests[1] then return nil end
+  return ('if not (%s) then %s end'):format(table.concat(tests, ' and '), call)
+end
+
+--- Rewrites the source of a module.
+-- @tparam string source the source of the module.
+-- @tparam string mode `'strip'` to remove the checks, or `'inline'` to inline them.
+-- @treturn string the rewritten source.
+-- @treturn integer the number of rewritten calls.
+-- @raise If `mode` is invalid, or if the source cannot be split into tokens.
+function M.rewrite(source, mode)
+  if mode ~= 'strip' and mode ~= 'inline' then
+    error(("bad argument #2 to 'rewrite' (invalid mode '%s')"):format(tostring(mode)), 2)
+  end
+
+  local tokens = tokenize(source)
+  local modules, functions = {}, {}
+  local blocks = {} -- for each open block, the parameters of the function or false
+  local parts, pos, count = {}, 1, 0
+  local i = 1
+  while i <= #tokens do
+    local t = tokens[i]
+    local prev = tokens[i - 1]
+    local next_i = i + 1
+    if t.kind == 'keyword' then
+      if t.text == 'function' then
+        blocks[#blocks + 1] = function_parameters(tokens, i + 1)
+      elseif t.text == 'do' or t.text == 'if' or t.text == 'repeat' then
+        blocks[#blocks + 1] = false
+      elseif t.text == 'end' or t.text == 'until' then
+        blocks[#blocks] = nil
+      elseif t.text == 'local' then
+        bind_locals(tokens, i, modules, functions)
+      end
+    elseif t.kind == 'name' and not (prev and EXPRESSION_PREFIXES[prev.text]) then
+      local fn, open
+      if functions[t.text] then
+        fn, open = functions[t.text], i + 1
+      elseif modules[t.text] and tokens[i + 1] and tokens[i + 1].text == '.' and tokens[i + 2]
+             and CHECKS[tokens[i + 2].text] then
+        fn, open = tokens[i + 2].text, i + 3
+      end
+      local close = fn and tokens[open] and tokens[open].text == '(' and matching(tokens, open)
+      local after = close and tokens[close + 1]
+      if close and not (after and (CALL_SUFFIXES[after.text] and after.kind == 'op' or after.kind == 'string')) then
+        local params
+        for k = #blocks, 1, -1 do
+          if blocks[k] then
+            params = blocks[k]
+            break
+          end
+        end
+        local replacement = rewrite_call(source, tokens, mode, fn, i, open, close, params)
+        if replacement then
+          parts[#parts + 1] = source:sub(pos, t.s - 1)
+          parts[#parts + 1] = replacement
+          pos = tokens[close].e + 1
+          count = count + 1
+          next_i = close + 1
+        end
+      end
+    end
+    i = next_i
+  end
+  parts[#parts + 1] = source:sub(pos)
+
+  local rewritten = table.concat(parts)
+  local prelude = mode == 'inline' and count > 0 and PRELUDE or ''
+  if rewritten:sub(1, 1) == '#' then
+    -- `load` does not skip the first line like `loadfile`, so it is turned into a comment
+    local first_line = rewritten:match('^[^\n]*\n?')
+    rewritten = '--' .. first_line .. prelude .. rewritten:sub(#first_line + 1)
+  else
+    rewritten = prelude .. rewritten
+  end
+  return rewritten, count
+end
+
+local installed
+
+local function searcher(name)
+  if name:find('^ldk%.checks') or not installed.filter(name) then return nil end
+  local filename = package.searchpath(name, package.path)
+  if not filename then return nil end
+
+  local file = io.open(filename, 'rb')
+  if not file then return nil end
+  local source = file:read('a')
+  file:close()
+  if source:sub(1, 1) == '\27' then return nil end -- precompiled
+
+  local ok, rewritten = pcall(M.rewrite, source, installed.mode)
+  local chunk, err = load(ok and rewritten or source, '@' .. filename)
+  if not chunk then
+    error(("error loading module '%s' from file '%s':\n\t%s"):format(name, filename, err), 0)
+  end
+  return chunk, filename
+end
+
+--- Installs the loader in `package.searchers`, before the searcher of the Lua modules.
+--
+-- Installing the loader again replaces its mode and its filter. Only the modules loaded after
+-- the installation are rewritten; a module that cannot be split into tokens is loaded as it is.
+-- @tparam string mode `'strip'` to remove the checks, or `'inline'` to inline them.
+-- @tparam[opt] string|function filter a pattern the name of a module must match, or a function
+-- that returns whether to rewrite a module given its name; by default all the modules are
+-- rewritten.
+-- @usage
+--    require('ldk.checks.loader').install('strip', '^myapp%.')
+function M.install(mode, filter)
+  if mode ~= 'strip' and mode ~= 'inline' then
+    error(("bad argument #1 to 'install' (invalid mode '%s')"):format(tostring(mode)), 2)
+  end
+  local filter_type = type(filter)
+  if filter_type == 'string' then
+    local pattern = filter
+    filter = function(name) return name:find(pattern) ~= nil end
+  elseif filter == nil then
+    filter = function() return true end
+  elseif filter_type ~= 'function' then
+    error(("bad argument #2 to 'install' (string or function expected, got %s)"):format(filter_type), 2)
+  end
+
+  if not installed then
+    table.insert(package.searchers, 2, searcher)
+  end
+  installed = {mode = mode, filter = filter}
+end
+
+--- Removes the loader from `package.searchers`.
+-- The modules already loaded are not affected.
+function M.uninstall()
+  if not installed then return end
+  for i, s in ipairs(package.searchers) do
+    if s == searcher then
+      table.remove(package.searchers, i)
+      break
+    end
+  end
+  installed = nil
+end
+
+return M